@@ -1,19 +1,68 @@
 #include "allocator.h"
 #include "freelist.h"
+#include "prof.h"
+#include "slab.h"
+#include "trace.h"
 
 #include <sys/mman.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <limits.h>
 #include <string.h> /* for memset */
+#include <stdlib.h>
+#include <unistd.h>
 
 /* global definitions that are: default to Best-Fit and Merging */
 int FIT_STRATEGY = BEST_FIT;
 int MERGE_ENABLED = 1;
+size_t MMAP_THRESHOLD = 128 * 1024;
+size_t PURGE_EAGER_MIN = 0;
 
-/* Per-arena heap pointers (mmap'd regions) */
-static void *heap_small = NULL;
-static void *heap_med   = NULL;
-static void *heap_large = NULL;
+/* runtime configuration (see allocator_config): the size-class boundaries and chunk sizes, the
+   other settings live in the globals above */
+static int n_arenas = 3;
+static _Atomic size_t small_max = SMALL_MAX, med_max = MED_MAX;   /* moved by adapt_boundaries */
+static size_t heap_size[3] = { SMALL_HEAP, MED_HEAP, LARGE_HEAP };
+static _Atomic int adaptive = 0;
+static int spill_policy = SPILL_WHEN_FULL;
+static size_t heap_limit = 0;               /* cap on mapped_total, 0 = none */
+static _Atomic int thp = 0;                 /* cleared again if the kernel rejects MADV_HUGEPAGE */
+static pthread_once_t config_once = PTHREAD_ONCE_INIT;
+
+#define PAGE_SIZE 4096
+
+_Static_assert(BLOCK_ALIGN == SMALLOC_ALIGN && SLAB_MAX % BLOCK_ALIGN == 0 && TCACHE_ALIGN == BLOCK_ALIGN,
+               "every path must hand out SMALLOC_ALIGN-aligned payloads");
+
+/* per-thread cache: bin i holds allocated-looking blocks with size >= i * TCACHE_ALIGN (so at
+   least PAYLOAD_ROUND(i * TCACHE_ALIGN)), chained through the free link in their payload */
+#define TCACHE_BINS (TCACHE_MAX / TCACHE_ALIGN + 1)
+
+typedef struct tcache {
+    common_header_t *bins[TCACHE_BINS];
+    int counts[TCACHE_BINS];
+    void *slab_bins[SLAB_CLASSES];  // slab slots, chained through their first word
+    int slab_counts[SLAB_CLASSES];
+    int registered;                 // thread-exit destructor installed
+    int sample_left;                // arena-bound requests until the next size sample
+} tcache_t;
+
+/* initial-exec: the cache must be reachable without a (possibly malloc-ing) TLS lookup when
+   this file is built into an LD_PRELOAD library */
+static __thread tcache_t tcache __attribute__((tls_model("initial-exec")));
+
+static pthread_once_t arenas_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tcache_key;
+
+static _Atomic size_t mapped_total = 0;     // bytes mapped by arena chunks and huge blocks
+
+static pthread_mutex_t huge_lock = PTHREAD_MUTEX_INITIALIZER;
+static chunk_t *huge_chunks = NULL;         // live huge mappings (guarded by huge_lock)
+static _Atomic size_t huge_mapped = 0, huge_blocks = 0;
+
+static void arena_lock(arena_t *arena);
 
 /* mmap wrapper */
 void *get_mem_block(void *addr, size_t mem_size) {
@@ -22,235 +71,1342 @@ void *get_mem_block(void *addr, size_t mem_size) {
     return (p == MAP_FAILED) ? NULL : p;
 }
 
+/* mmap a block aligned to align (a power of two): over-map, then trim both ends */
+void *get_aligned_mem_block(size_t mem_size, size_t align) {
+    uint8_t *raw = get_mem_block(NULL, mem_size + align);
+    if (raw == NULL) return NULL;
+    uint8_t *p = (uint8_t*)(((uintptr_t)raw + align - 1) & ~(uintptr_t)(align - 1));
+    if (p > raw) munmap(raw, (size_t)(p - raw));
+    munmap(p + mem_size, (size_t)(raw + align - p));
+    return p;
+}
+
+/* Ask for transparent huge pages on a fresh chunk mapping; returns whether it was advised.
+   Kernels built without THP reject the advice (EINVAL): the option is turned off for good. */
+static int thp_advise(void *mem, size_t size) {
+    if (!atomic_load_explicit(&thp, memory_order_relaxed) || size < HUGE_PAGE) return 0;
+    if (madvise(mem, size, MADV_HUGEPAGE) == 0) return 1;
+    atomic_store(&thp, 0);
+    return 0;
+}
+
+/* chunk owning a block / payload pointer */
+#define CHUNK_OF(p) ((chunk_t*)((uintptr_t)(p) & ~(uintptr_t)(CHUNK_ALIGN - 1)))
+
 /* utility: requested memory includes header */
 size_t allocator_req_mem(size_t payload) {
     return payload + sizeof(common_header_t);
 }
 
-/* total free data allocation bytes across all arenas */
-size_t allocator_free_mem_size(void) {
-    size_t sum = 0;
-    common_header_t *c;
-    for (c = freelist_small; c; c = c->next) sum += c->size;
-    for (c = freelist_med;   c; c = c->next) sum += c->size;
-    for (c = freelist_large; c; c = c->next) sum += c->size;
-    return sum;
+/* Stats helper: the arena's incremental counters, plus its largest free block */
+static void collect_from_arena(arena_t *arena, size_t* N, size_t* F, size_t* L) {
+    arena_lock(arena);
+    *N += atomic_load_explicit(&arena->free_blocks, memory_order_relaxed);
+    *F += atomic_load_explicit(&arena->free_bytes, memory_order_relaxed);
+    size_t largest = bin_largest(arena);
+    if (largest > *L) *L = largest;
+    pthread_mutex_unlock(&arena->lock);
 }
 
-/* print all freelists */
-void allocator_list_dump(void) {
-    common_header_t *c;
-    printf("Small: ");
-    c = freelist_small;
-    if (!c) printf("(empty)");
-    while (c) { printf("[%d]", c->size); if (c->next) printf(" -> "); c = c->next; }
-    printf("\n");
+/* total free data allocation bytes across all arenas (lock-free: counters only) */
+size_t allocator_free_mem_size(void) {
+    return atomic_load_explicit(&arena_small.free_bytes, memory_order_relaxed)
+         + atomic_load_explicit(&arena_med.free_bytes, memory_order_relaxed)
+         + atomic_load_explicit(&arena_large.free_bytes, memory_order_relaxed);
+}
 
-    printf("Med:   ");
-    c = freelist_med;
-    if (!c) printf("(empty)");
-    while (c) { printf("[%d]", c->size); if (c->next) printf(" -> "); c = c->next; }
-    printf("\n");
+/* total bytes mapped by the three arenas and the huge blocks */
+size_t allocator_mapped_size(void) {
+    return atomic_load_explicit(&mapped_total, memory_order_relaxed);
+}
 
-    printf("Large: ");
-    c = freelist_large;
-    if (!c) printf("(empty)");
-    while (c) { printf("[%d]", c->size); if (c->next) printf(" -> "); c = c->next; }
+/* print one arena's free blocks in address order, chunk by chunk (walks the boundary tags) */
+static void dump_arena(const char *name, arena_t *arena) {
+    int first = 1;
+    arena_lock(arena);
+    printf("%s", name);
+    for (chunk_t *ch = arena->chunks; ch; ch = ch->next) {
+        int chunk_first = 1;
+        for (common_header_t *c = CHUNK_FIRST_BLOCK(ch); c->size > 0; c = NEXT_BLOCK(c)) {
+            if (c->flags & BLOCK_IN_USE) continue;
+            if (!first) printf(chunk_first ? " | " : " -> ");
+            printf("[%d]", c->size);
+            first = chunk_first = 0;
+        }
+    }
+    if (first) printf("(empty)");
     printf("\n");
+    pthread_mutex_unlock(&arena->lock);
 }
 
-/* Stats helper: collect from a single freelist head */
-static void collect_from_head(common_header_t *head, size_t* N, size_t* F, size_t* L) {
-    for (common_header_t *c = head; c; c = c->next) {
-        (*N)++;
-        (*F) += (size_t)c->size;
-        if ((size_t)c->size > *L) *L = (size_t)c->size;
-    }
+/* print all freelists */
+void allocator_list_dump(void) {
+    dump_arena("Small: ", &arena_small);
+    dump_arena("Med:   ", &arena_med);
+    dump_arena("Large: ", &arena_large);
 }
 
 /* aggregate stats across the three arenas */
 void allocator_stats(size_t* N, size_t* F, size_t* L) {
     if (!N || !F || !L) return;
     *N = *F = *L = 0;
-    collect_from_head(freelist_small, N, F, L);
-    collect_from_head(freelist_med,   N, F, L);
-    collect_from_head(freelist_large, N, F, L);
+    collect_from_arena(&arena_small, N, F, L);
+    collect_from_arena(&arena_med,   N, F, L);
+    collect_from_arena(&arena_large, N, F, L);
 }
 
-/* Ensure arenas are created and initialised */
-void init_arenas(void) {
-    if (!heap_small) {
-        heap_small = get_mem_block(NULL, SMALL_HEAP);
-        if (heap_small) init_free_list_explicit(&freelist_small, heap_small, SMALL_HEAP);
-    }
-    if (!heap_med) {
-        heap_med = get_mem_block(NULL, MED_HEAP);
-        if (heap_med) init_free_list_explicit(&freelist_med, heap_med, MED_HEAP);
+static void tcache_destroy(void *unused);
+
+/* count size new bytes in mapped_total before mapping them; 0 if that would exceed heap_limit */
+static int map_reserve(size_t size) {
+    size_t before = atomic_fetch_add_explicit(&mapped_total, size, memory_order_relaxed);
+    if (heap_limit != 0 && before + size > heap_limit) {
+        atomic_fetch_sub_explicit(&mapped_total, size, memory_order_relaxed);
+        return 0;
     }
-    if (!heap_large) {
-        heap_large = get_mem_block(NULL, LARGE_HEAP);
-        if (heap_large) init_free_list_explicit(&freelist_large, heap_large, LARGE_HEAP);
+    return 1;
+}
+
+/* Map one more chunk for an arena, big enough for a payload n (at least the arena's chunk size).
+   Caller holds arena->lock, or is the one-time initialisation. */
+static int arena_grow(arena_t *arena, size_t n) {
+    size_t overhead = CHUNK_HDR + 2 * sizeof(common_header_t);
+    size_t size = arena->chunk_size;
+    if (n + overhead > size) size = (n + overhead + 4095) & ~(size_t)4095;
+    if (atomic_load_explicit(&thp, memory_order_relaxed)) size = (size + HUGE_PAGE - 1) & ~(size_t)(HUGE_PAGE - 1);
+    if (size > CHUNK_ALIGN) return 0;   /* would not be found by CHUNK_OF */
+    if (!map_reserve(size)) return 0;
+
+    chunk_t *chunk = get_aligned_mem_block(size, CHUNK_ALIGN);
+    if (chunk == NULL) {
+        atomic_fetch_sub_explicit(&mapped_total, size, memory_order_relaxed);
+        return 0;
     }
+    int huge = thp_advise(chunk, size);    /* before the first touch faults in a small page */
+    chunk->arena = arena;
+    chunk->size = size;
+    chunk->thp = huge;
+    chunk_list_push(&arena->chunks, chunk);
+    COUNTER_ADD(arena->mapped, size);
+
+    init_free_list_explicit(arena, CHUNK_FIRST_BLOCK(chunk), size - CHUNK_HDR);
+    return 1;
+}
+
+/* Unmap a chunk whose blocks are all free again (one free block spanning it), unless it is the
+   arena's last chunk, or the rest of the arena has less than two chunks free: then a burst of
+   allocations after a burst of frees (smalloc_batch, sfree_batch) would only map it again.
+   Caller holds arena->lock and has taken the block out of the bins. */
+static int arena_release_chunk(arena_t *arena, common_header_t *block) {
+    chunk_t *chunk = CHUNK_OF(block);
+    if (block != CHUNK_FIRST_BLOCK(chunk) || NEXT_BLOCK(block)->size != 0) return 0;
+    if (arena->chunks == chunk && chunk->next == NULL) return 0;
+    if (atomic_load_explicit(&arena->free_bytes, memory_order_relaxed) < 2 * arena->chunk_size) return 0;
+
+    chunk_list_remove(&arena->chunks, chunk);
+    COUNTER_SUB(arena->mapped, chunk->size);
+    atomic_fetch_sub_explicit(&mapped_total, chunk->size, memory_order_relaxed);
+    munmap(chunk, chunk->size);
+    return 1;
 }
 
-/* Helper: choose arena head pointer by requested payload size */
-static common_header_t **arena_head_for_size(size_t n) {
-    if (n <= SMALL_MAX) return &freelist_small;
-    else if (n <= MED_MAX)   return &freelist_med;
-    else return &freelist_large;
+/* fork(): hold every allocator lock across the fork so the child never inherits an arena
+   locked halfway through an operation by another thread */
+static void fork_prepare(void) {
+    pthread_mutex_lock(&arena_small.lock);
+    pthread_mutex_lock(&arena_med.lock);
+    pthread_mutex_lock(&arena_large.lock);
+    pthread_mutex_lock(&huge_lock);
+    slab_lock_all();
 }
 
-/* Helper: determine arena head by pointer value (when freeing). Uses address ranges. */
-static common_header_t **arena_head_for_ptr(void *ptr) {
-    if (ptr == NULL) return &freelist_small; 
-    uintptr_t p = (uintptr_t)ptr;
+static void fork_release(void) {
+    slab_unlock_all();
+    pthread_mutex_unlock(&huge_lock);
+    pthread_mutex_unlock(&arena_large.lock);
+    pthread_mutex_unlock(&arena_med.lock);
+    pthread_mutex_unlock(&arena_small.lock);
+}
 
-    if (heap_small) {
-        uintptr_t start = (uintptr_t)heap_small;
-        uintptr_t end = start + SMALL_HEAP;
-        if (p >= start && p < end) return &freelist_small;
-    }
-    if (heap_med) {
-        uintptr_t start = (uintptr_t)heap_med;
-        uintptr_t end = start + MED_HEAP;
-        if (p >= start && p < end) return &freelist_med;
-    }
-    // default
-    return &freelist_large;
+static void config_from_env_once(void);
+
+/* Create the arenas exactly once (only the arenas in use get their first chunk) */
+static void init_arenas_once(void) {
+    pthread_once(&config_once, config_from_env_once);
+    pthread_key_create(&tcache_key, tcache_destroy);
+    pthread_atfork(fork_prepare, fork_release, fork_release);
+    slab_init(get_mem_block(NULL, SLAB_HEAP), SLAB_HEAP);
+    arena_small.chunk_size = heap_size[0];
+    arena_med.chunk_size   = heap_size[1];
+    arena_large.chunk_size = heap_size[2];
+    if (n_arenas >= 2) arena_grow(&arena_small, 0);
+    if (n_arenas == 3) arena_grow(&arena_med, 0);
+    arena_grow(&arena_large, 0);
 }
 
-/* Insert sorted into a specified freelist; return previous node pointer (or NULL if inserted at head) */
-static common_header_t *insert_sorted_and_return_prev(common_header_t *block, common_header_t **head) {
-    if (head == NULL || block == NULL) return NULL;
+/* Ensure arenas are created and initialised */
+void init_arenas(void) {
+    pthread_once(&arenas_once, init_arenas_once);
+}
+
+/* Helper: choose arena by requested payload size */
+static arena_t *arena_for_size(size_t n) {
+    if (n <= atomic_load_explicit(&small_max, memory_order_relaxed)) return &arena_small;
+    else if (n <= atomic_load_explicit(&med_max, memory_order_relaxed)) return &arena_med;
+    else return &arena_large;
+}
 
-    if (*head == NULL || block < *head) {
-        block->next = *head;
-        *head = block;
-        return NULL; // no previous node
+/* Adaptive boundaries: every ADAPT_SAMPLE-th arena-bound request (per thread) adds its size to
+   a byte-weighted histogram over the TLSF bins. Every ADAPT_PERIOD samples the boundaries move
+   to the tertiles of the requested bytes, so each arena serves about a third of the load, and
+   the arenas' next chunks are sized by their share. The histogram is then halved, so it follows
+   shifts in the traffic. */
+static _Atomic uint64_t size_hist[FL_COUNT][SL_COUNT];
+static _Atomic unsigned size_samples = 0;
+static _Atomic size_t adaptations = 0;
+static pthread_mutex_t adapt_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* smallest size of a bin (inverse of bin_mapping) */
+static size_t bin_low(int fl, int sl) {
+    return (fl == 0) ? (size_t)sl : (size_t)(SL_COUNT + sl) << (fl - 1);
+}
+
+/* chunk size for an arena carrying share of budget bytes: a power of two in 256 KB .. CHUNK_ALIGN */
+static size_t adapt_heap(double share, size_t budget) {
+    size_t want = (size_t)(share * (double)budget), size = 256 * 1024;
+    while (size < want && size < CHUNK_ALIGN) size *= 2;
+    return size;
+}
+
+/* a boundary only moves when it is off by more than an eighth (no churn on noise) */
+static void adapt_move(_Atomic size_t *bound, size_t target) {
+    size_t cur = atomic_load_explicit(bound, memory_order_relaxed);
+    if (target > cur + cur / 8 || target + target / 8 < cur) atomic_store_explicit(bound, target, memory_order_relaxed);
+}
+
+static void adapt_boundaries(void) {
+    uint64_t total = 0;
+    for (int fl = 0; fl < FL_COUNT; fl++)
+        for (int sl = 0; sl < SL_COUNT; sl++) total += atomic_load_explicit(&size_hist[fl][sl], memory_order_relaxed);
+    if (total == 0) return;
+
+    /* split points: the bytes below each boundary reach k / n_arenas of the total */
+    size_t bound[2] = { 0, 0 };
+    uint64_t below[3] = { 0, 0, 0 }, cum = 0;
+    int k = 0;
+    for (int fl = 0; fl < FL_COUNT; fl++) {
+        for (int sl = 0; sl < SL_COUNT; sl++) {
+            uint64_t h = atomic_load_explicit(&size_hist[fl][sl], memory_order_relaxed);
+            cum += h;
+            below[k] += h;
+            atomic_store_explicit(&size_hist[fl][sl], h / 2, memory_order_relaxed);   /* decay */
+            while (k < n_arenas - 1 && cum * (uint64_t)n_arenas >= total * (uint64_t)(k + 1)) {
+                int nfl = fl, nsl = sl + 1;
+                if (nsl == SL_COUNT) { nfl++; nsl = 0; }
+                bound[k++] = bin_low(nfl, nsl) - 1;     /* the whole bin goes below the boundary */
+            }
+        }
+    }
+    if (n_arenas == 3) {
+        adapt_move(&small_max, bound[0]);
+        adapt_move(&med_max, bound[1] > bound[0] ? bound[1] : bound[0]);
+    } else if (n_arenas == 2) {
+        adapt_move(&small_max, bound[0]);
+        atomic_store_explicit(&med_max, atomic_load(&small_max), memory_order_relaxed);
     }
 
-    common_header_t *cur = *head;
-    while (cur->next != NULL && cur->next < block) {
-        cur = cur->next;
+    /* chunk sizes for newly mapped chunks, out of the configured total */
+    arena_t *arenas[3] = { &arena_small, &arena_med, &arena_large };
+    uint64_t share[3] = { below[0], n_arenas == 3 ? below[1] : 0, below[n_arenas - 1] };
+    if (n_arenas == 1) share[0] = 0;
+    size_t budget = heap_size[0] + heap_size[1] + heap_size[2];
+    for (int a = 0; a < 3; a++) {
+        if (share[a] == 0) continue;
+        pthread_mutex_lock(&arenas[a]->lock);
+        arenas[a]->chunk_size = adapt_heap((double)share[a] / (double)total, budget);
+        pthread_mutex_unlock(&arenas[a]->lock);
     }
+    atomic_fetch_add_explicit(&adaptations, 1, memory_order_relaxed);
+}
+
+static void size_sample(size_t n) {
+    tcache.sample_left = ADAPT_SAMPLE;
+    if (!atomic_load_explicit(&adaptive, memory_order_relaxed)) return;
+    int fl, sl;
+    bin_mapping(n, &fl, &sl);
+    atomic_fetch_add_explicit(&size_hist[fl][sl], n, memory_order_relaxed);
+    if ((atomic_fetch_add_explicit(&size_samples, 1, memory_order_relaxed) + 1) % ADAPT_PERIOD != 0) return;
+    if (pthread_mutex_trylock(&adapt_lock) != 0) return;    /* another thread is on it */
+    adapt_boundaries();
+    pthread_mutex_unlock(&adapt_lock);
+}
 
-    block->next = cur->next;
-    cur->next = block;
-    return cur;
+/* Runtime configuration. The arena count folds the boundaries: with 2 arenas the medium one
+   is unused, with 1 everything goes to the large arena. */
+static void config_get(allocator_config_t *cfg) {
+    cfg->fit_strategy = FIT_STRATEGY;
+    cfg->merge_enabled = MERGE_ENABLED;
+    cfg->arenas = n_arenas;
+    cfg->small_max = small_max;
+    cfg->med_max = med_max;
+    cfg->small_heap = heap_size[0];
+    cfg->med_heap = heap_size[1];
+    cfg->large_heap = heap_size[2];
+    cfg->mmap_threshold = MMAP_THRESHOLD;
+    cfg->purge_eager_min = PURGE_EAGER_MIN;
+    cfg->adaptive = atomic_load(&adaptive);
+    cfg->spill = spill_policy;
+    cfg->heap_limit = heap_limit;
+    cfg->thp = atomic_load(&thp);
 }
 
-/* Merge helpers operate only on the provided freelist nodes (no global) */
-static int try_merge_with_next(common_header_t *block) {
-    if (block == NULL || block->next == NULL) return 0;
+void allocator_get_config(allocator_config_t *cfg) {
+    pthread_once(&config_once, config_from_env_once);
+    config_get(cfg);
+}
+
+static int heap_size_valid(size_t size) {
+    return size >= 64 * 1024 && size <= CHUNK_ALIGN && size % PAGE_SIZE == 0;
+}
+
+static int config_apply(const allocator_config_t *cfg) {
+    if (cfg->fit_strategy < FIRST_FIT || cfg->fit_strategy > TLSF_FIT) return -1;
+    if (cfg->arenas < 1 || cfg->arenas > 3) return -1;
+    if (cfg->spill < SPILL_OFF || cfg->spill > SPILL_EAGER) return -1;
+    if (cfg->arenas == 3 && cfg->small_max > cfg->med_max) return -1;
+    if (cfg->small_max > INT_MAX || cfg->med_max > INT_MAX) return -1;
+    if (!heap_size_valid(cfg->small_heap) || !heap_size_valid(cfg->med_heap) ||
+        !heap_size_valid(cfg->large_heap)) return -1;
+
+    FIT_STRATEGY = cfg->fit_strategy;
+    MERGE_ENABLED = cfg->merge_enabled;
+    MMAP_THRESHOLD = cfg->mmap_threshold;
+    PURGE_EAGER_MIN = cfg->purge_eager_min;
+    n_arenas = cfg->arenas;
+    atomic_store(&small_max, (cfg->arenas >= 2) ? cfg->small_max : 0);
+    atomic_store(&med_max, (cfg->arenas == 3) ? cfg->med_max : atomic_load(&small_max));
+    atomic_store(&adaptive, cfg->adaptive != 0);
+    spill_policy = cfg->spill;
+    heap_limit = cfg->heap_limit;
+    atomic_store(&thp, cfg->thp != 0);
 
-    uint8_t *block_end = (uint8_t*)block + sizeof(common_header_t) + (size_t)block->size;
-    if (block_end == (uint8_t*)block->next) { // adjacent: absorb next
-        block->size += (int)(sizeof(common_header_t) + (size_t)block->next->size);
-        block->next = block->next->next;
-        return 1;
+    /* new chunk sizes apply to the next chunk each arena maps */
+    arena_t *arenas[3] = { &arena_small, &arena_med, &arena_large };
+    size_t sizes[3] = { cfg->small_heap, cfg->med_heap, cfg->large_heap };
+    for (int a = 0; a < 3; a++) {
+        pthread_mutex_lock(&arenas[a]->lock);
+        heap_size[a] = sizes[a];
+        if (arenas[a]->chunk_size) arenas[a]->chunk_size = sizes[a];
+        pthread_mutex_unlock(&arenas[a]->lock);
     }
     return 0;
 }
 
-static int try_merge_prev_with_next(common_header_t *prev) {
-    if (prev == NULL || prev->next == NULL) return 0;
+/* explicit settings win over SMALLOC_CONF, which is applied first */
+int allocator_config(const allocator_config_t *cfg) {
+    pthread_once(&config_once, config_from_env_once);
+    return config_apply(cfg);
+}
+
+/* warnings from inside the allocator: no stdio (which may allocate) */
+static void config_warn(const char *what, const char *opt, int len) {
+    char msg[256];
+    int n = snprintf(msg, sizeof msg, "smalloc: %s '%.*s'\n", what, len, opt);
+    if (n > (int)sizeof msg - 1) n = (int)sizeof msg - 1;
+    if (n > 0 && write(2, msg, (size_t)n) < 0) return;
+}
+
+/* "123", "64K", "4M" -> bytes; returns 0 on a malformed value */
+static int parse_size(const char *v, size_t len, size_t *out) {
+    size_t n = 0, i = 0;
+    if (len == 0) return 0;
+    for (; i < len && v[i] >= '0' && v[i] <= '9'; i++) n = n * 10 + (size_t)(v[i] - '0');
+    if (i == 0) return 0;
+    if (i + 1 == len && (v[i] == 'K' || v[i] == 'k')) n <<= 10;
+    else if (i + 1 == len && (v[i] == 'M' || v[i] == 'm')) n <<= 20;
+    else if (i != len) return 0;
+    *out = n;
+    return 1;
+}
 
-    uint8_t *prev_end = (uint8_t*)prev + sizeof(common_header_t) + (size_t)prev->size;
-    if (prev_end == (uint8_t*)prev->next) {
-        prev->size += (int)(sizeof(common_header_t) + (size_t)prev->next->size);
-        prev->next = prev->next->next;
-        return 1;
+/* Apply a SMALLOC_CONF string (see allocator.h). Unknown keys and bad values are reported
+   on stderr and skipped; returns the number of options applied. */
+static int config_parse(const char *conf) {
+    allocator_config_t cfg;
+    config_get(&cfg);
+    int applied = 0;
+
+    for (const char *p = conf; p && *p; ) {
+        const char *end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        const char *colon = memchr(p, ':', len);
+        int ok = 0;
+        if (colon) {
+            size_t klen = (size_t)(colon - p), vlen = len - klen - 1;
+            const char *v = colon + 1;
+            size_t n = 0;
+#define KEY(k) (klen == sizeof(k) - 1 && strncmp(p, k, klen) == 0)
+#define VAL(x) (vlen == sizeof(x) - 1 && strncmp(v, x, vlen) == 0)
+            if (KEY("fit")) {
+                ok = 1;
+                if (VAL("first")) cfg.fit_strategy = FIRST_FIT;
+                else if (VAL("best")) cfg.fit_strategy = BEST_FIT;
+                else if (VAL("tlsf")) cfg.fit_strategy = TLSF_FIT;
+                else ok = 0;
+            } else if (KEY("spill")) {
+                ok = 1;
+                if (VAL("off")) cfg.spill = SPILL_OFF;
+                else if (VAL("full")) cfg.spill = SPILL_WHEN_FULL;
+                else if (VAL("eager")) cfg.spill = SPILL_EAGER;
+                else ok = 0;
+            } else if (KEY("purge") && VAL("off")) {
+                cfg.purge_eager_min = 0;
+                ok = 1;
+            } else if (parse_size(v, vlen, &n)) {
+                ok = 1;
+                if (KEY("merge")) cfg.merge_enabled = (n != 0);
+                else if (KEY("arenas")) cfg.arenas = (int)n;
+                else if (KEY("small_max")) cfg.small_max = n;
+                else if (KEY("med_max")) cfg.med_max = n;
+                else if (KEY("small_heap")) cfg.small_heap = n;
+                else if (KEY("med_heap")) cfg.med_heap = n;
+                else if (KEY("large_heap")) cfg.large_heap = n;
+                else if (KEY("mmap_threshold")) cfg.mmap_threshold = n;
+                else if (KEY("purge")) cfg.purge_eager_min = n;
+                else if (KEY("adaptive")) cfg.adaptive = (n != 0);
+                else if (KEY("heap_limit")) cfg.heap_limit = n;
+                else if (KEY("thp")) cfg.thp = (n != 0);
+                else ok = 0;
+            }
+#undef KEY
+#undef VAL
+        }
+        if (ok) applied++;
+        else config_warn("ignoring config option", p, (int)len);
+        p = end ? end + 1 : NULL;
     }
-    return 0;
+
+    if (config_apply(&cfg) != 0) {
+        config_warn("invalid configuration, keeping the previous one:", conf, (int)strlen(conf));
+        return 0;
+    }
+    return applied;
 }
 
-/* smalloc: selects arena, finds best/first fit, splits/removes from that arena's freelist */
-void *smalloc(size_t n) {
-    if (n == 0) return NULL;
+int allocator_config_parse(const char *conf) {
+    pthread_once(&config_once, config_from_env_once);
+    return config_parse(conf);
+}
 
-    /* Ensure arenas exist */
-    init_arenas();
+/* SMALLOC_CONF is read once, before the arenas are created */
+static void config_from_env_once(void) {
+    const char *conf = getenv("SMALLOC_CONF");
+    if (conf != NULL && *conf != '\0') config_parse(conf);
+}
 
-    /* Select arena freelist */
-    common_header_t **arena_head = arena_head_for_size(n);
-    if (arena_head == NULL) return NULL;
+/* Helper: determine arena by pointer value (when freeing), from the header of its chunk */
+static arena_t *arena_for_ptr(void *ptr) {
+    return CHUNK_OF(ptr)->arena;
+}
 
-    /* Search freelist for best/first fit */
+/* Best fit through the size bins: scan the request's own bin, then take the smallest
+   block of the first non-empty larger bin (every block there fits). The large arena, where
+   bins get long, answers from its size trees instead; they are built on its first best-fit
+   request. */
+static common_header_t *find_best_fit(arena_t *arena, size_t n) {
+    if (arena == &arena_large && n >= TREE_MIN) {  /* exact, O(log N) */
+        if (!arena->indexed) tree_index(arena, 1);
+        return tree_lower_bound(arena, n);
+    }
+
+    int fl, sl;
+    bin_mapping(n, &fl, &sl);
     common_header_t *best = NULL;
-    common_header_t *best_prev = NULL;
-    common_header_t *prev = NULL;
-    common_header_t *cur = *arena_head;
-
-    while (cur != NULL) {
-        if ((size_t)cur->size >= n) {
-            if (FIT_STRATEGY == BEST_FIT) {
-                if (best == NULL || cur->size < best->size) {
-                    best = cur;
-                    best_prev = prev;
-                }
-            } else { /* FIRST_FIT */
-                best = cur;
-                best_prev = prev;
-                break;
-            }
+
+    for (common_header_t *c = arena->bins[fl][sl]; c; c = FREE_LINKS(c)->next) {
+        if ((size_t)c->size >= n && (best == NULL || c->size < best->size)) best = c;
+    }
+    if (best != NULL) return best;
+
+    sl++;
+    if (!bin_find_from(arena, &fl, &sl)) return NULL;
+
+    for (common_header_t *c = arena->bins[fl][sl]; c; c = FREE_LINKS(c)->next) {
+        if (best == NULL || c->size < best->size) best = c;
+    }
+    return best;
+}
+
+/* TLSF good fit: round the request up to the next bin boundary so that any block of the
+   first non-empty bin found by the bitmaps fits. Bounded time, no list scan. */
+static common_header_t *find_tlsf_fit(arena_t *arena, size_t n) {
+    if (n >= SL_COUNT) {
+        int log2 = 31 - __builtin_clz((unsigned)n);
+        n += ((size_t)1 << (log2 - SL_LOG2)) - 1;
+    }
+    int fl, sl;
+    bin_mapping(n, &fl, &sl);
+    if (!bin_find_from(arena, &fl, &sl)) return NULL;
+    return arena->bins[fl][sl];
+}
+
+/* Segregated first fit: walk the bins upwards from the request's bin, take the first block that fits */
+static common_header_t *find_first_fit(arena_t *arena, size_t n) {
+    int fl, sl;
+    bin_mapping(n, &fl, &sl);
+    while (bin_find_from(arena, &fl, &sl)) {
+        for (common_header_t *c = arena->bins[fl][sl]; c; c = FREE_LINKS(c)->next) {
+            if ((size_t)c->size >= n) return c;
         }
-        prev = cur;
-        cur = cur->next;
+        sl++;
+    }
+    return NULL;
+}
+
+static void arena_take(arena_t *arena, common_header_t *best, size_t n);
+
+/* arena_malloc: finds best/first/TLSF fit, splits/removes it from the arena's bins.
+   Caller holds arena->lock. */
+static common_header_t *arena_malloc(arena_t *arena, size_t n, int grow) {
+    /* Search arena for best/first fit */
+    common_header_t *best;
+    if (FIT_STRATEGY != BEST_FIT && arena->indexed) tree_index(arena, 0);  /* nothing reads them */
+    if (FIT_STRATEGY == TLSF_FIT) best = find_tlsf_fit(arena, n);
+    else if (FIT_STRATEGY == BEST_FIT) best = find_best_fit(arena, n);
+    else best = find_first_fit(arena, n);
+
+    if (best == NULL) {
+        /* no free block big enough: grow by one chunk, whose single free block fits */
+        if (!grow || !arena_grow(arena, n)) return NULL;
+        best = CHUNK_FIRST_BLOCK(arena->chunks);
     }
+    arena_take(arena, best, n);
+    return best;
+}
 
-    if (best == NULL) return NULL; /* no free block big enough */
+/* Take a free block out of the bins and allocate payload n from its front, the rest staying
+   free if it can stand alone. Caller holds arena->lock. */
+static void arena_take(arena_t *arena, common_header_t *best, size_t n) {
+    bin_remove(arena, best);
 
     /* split condition variable */
     int remainder = best->size - (int)n - (int)sizeof(common_header_t);
 
-    if (remainder >= (int)(sizeof(common_header_t) + 1)) {
+    if (remainder >= MIN_PAYLOAD) {
         /* create new free block after allocated region */
         uint8_t *base = (uint8_t*)best;
         common_header_t *new_block = (common_header_t*)(base + sizeof(common_header_t) + n);
         new_block->size = remainder;
-        new_block->next = best->next;
+        new_block->flags = 0;
+        new_block->tag = 0;
 
         best->size = (int)n;
 
-        /* replace best in freelist with new_block */
-        if (best_prev == NULL) {
-            *arena_head = new_block;
-        } else {
-            best_prev->next = new_block;
+        block_set_free(new_block);
+        bin_insert(arena, new_block);
+    }
+    block_set_used(best);
+    best->tag = 0;
+}
+
+/* Spillover: serve a request its own arena could not from a neighbouring arena's free blocks
+   (larger classes first, their blocks are more likely to fit). sfree finds the owner from the
+   chunk, so the block simply goes back to the arena it came from. */
+static common_header_t *spill_malloc(arena_t *home, size_t n) {
+    arena_t *arenas[3] = { &arena_small, &arena_med, &arena_large };
+    int h = (home == &arena_small) ? 0 : (home == &arena_med) ? 1 : 2;
+    int order[4] = { h + 1, h - 1, h + 2, h - 2 };
+
+    for (int k = 0; k < 4; k++) {
+        if (order[k] < 0 || order[k] > 2) continue;
+        arena_t *other = arenas[order[k]];
+        arena_lock(other);
+        common_header_t *block = arena_malloc(other, n, 0);
+        pthread_mutex_unlock(&other->lock);
+        if (block != NULL) {
+            atomic_fetch_add_explicit(&other->spilled_in, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&home->spilled_out, 1, memory_order_relaxed);
+            return block;
         }
+    }
+    return NULL;
+}
+
+/* arena_malloc under the arena's lock, falling back to the neighbours per spill_policy: when
+   the arena has no fit and cannot grow (SPILL_WHEN_FULL), or before it grows (SPILL_EAGER) */
+static common_header_t *arena_alloc(arena_t *arena, size_t n) {
+    int eager = (spill_policy == SPILL_EAGER);
+    arena_lock(arena);
+    common_header_t *block = arena_malloc(arena, n, !eager);
+    pthread_mutex_unlock(&arena->lock);
+    if (block != NULL || spill_policy == SPILL_OFF) return block;
+
+    block = spill_malloc(arena, n);
+    if (block == NULL && eager) {
+        arena_lock(arena);
+        block = arena_malloc(arena, n, 1);
+        pthread_mutex_unlock(&arena->lock);
+    }
+    return block;
+}
+
+/* Carve up to count blocks of payload n (a PAYLOAD_ROUND size) out of one free block: one
+   fit search and one split for the whole run, then the run is cut into consecutive in-use
+   blocks (the last one keeps any slack). When no free block holds the whole run, the largest
+   one is carved for as many blocks as it holds, and only without one of those the arena grows.
+   Caller holds arena->lock. Returns the number of blocks carved. */
+static size_t arena_malloc_run(arena_t *arena, size_t n, size_t count, void **out) {
+    size_t stride = sizeof(common_header_t) + n;
+    size_t k = (arena->chunk_size - CHUNK_HDR - sizeof(common_header_t)) / stride;  /* at most a chunk */
+    if (k == 0) k = 1;
+    if (k > count) k = count;
+
+    common_header_t *run = arena_malloc(arena, k * stride - sizeof(common_header_t), 0);
+    if (run == NULL) {
+        size_t fits = (bin_largest(arena) + sizeof(common_header_t)) / stride;
+        if (fits > 0) {
+            k = fits < k ? fits : k;
+            /* an exhaustive search: TLSF's rounding could miss the largest block. Only best fit
+               keeps the large arena's trees, the others walk the bins without building them. */
+            size_t want = k * stride - sizeof(common_header_t);
+            run = (FIT_STRATEGY == BEST_FIT) ? find_best_fit(arena, want) : find_first_fit(arena, want);
+            arena_take(arena, run, want);
+        }
+    }
+    while (run == NULL) {
+        run = arena_malloc(arena, k * stride - sizeof(common_header_t), 1);
+        if (run == NULL && (k /= 2) == 0) return 0;
+    }
+
+    size_t total = (size_t)run->size + sizeof(common_header_t);
+    for (size_t j = 0; j < k; j++) {
+        common_header_t *block = (common_header_t*)((uint8_t*)run + j * stride);
+        if (j > 0) {                                /* the first keeps its BLOCK_PREV_FREE */
+            block->flags = BLOCK_IN_USE;
+            block->tag = 0;
+        }
+        block->size = (j + 1 < k) ? (int)n : (int)(total - j * stride - sizeof(common_header_t));
+        out[j] = (uint8_t*)block + sizeof(common_header_t);
+    }
+    return k;
+}
+
+/* resident bytes of one mapping, from mincore */
+static size_t resident_size(void *mem, size_t size) {
+    unsigned char vec[256];
+    size_t resident = 0;
+    for (size_t off = 0; off < size; off += sizeof(vec) * PAGE_SIZE) {
+        size_t len = size - off;
+        if (len > sizeof(vec) * PAGE_SIZE) len = sizeof(vec) * PAGE_SIZE;
+        if (mincore((uint8_t*)mem + off, len, vec) != 0) continue;
+        for (size_t i = 0; i < (len + PAGE_SIZE - 1) / PAGE_SIZE; i++) {
+            if (vec[i] & 1) resident += PAGE_SIZE;
+        }
+    }
+    return resident;
+}
+
+/* Hand the whole pages inside a free block back to the OS. The header, free link, tree node and
+   footer stay intact; the pages read as zero (and cost no memory) until they are touched again.
+   In a chunk on transparent huge pages the eager purge in sfree (split 0) only drops whole huge
+   pages, since dropping part of one splits it into small pages for good; allocator_purge asks for
+   the memory explicitly and splits them (split 1) and returns the resident bytes it dropped;
+   pages never touched since the last purge are advised too but not counted. The eager purge
+   ignores the count, so it skips the mincore call. */
+static size_t purge_block(common_header_t *block, int split) {
+    if (block->flags & BLOCK_PURGED) return 0;
+
+    size_t page = (CHUNK_OF(block)->thp && !split) ? HUGE_PAGE : PAGE_SIZE;
+    if (page == PAGE_SIZE) block->flags |= BLOCK_PURGED;   /* nothing left to drop */
+    uintptr_t lo = (uintptr_t)FREE_TREE(block) + sizeof(free_tree_t);
+    uintptr_t hi = (uintptr_t)FOOTER(block);
+    lo = (lo + page - 1) & ~(uintptr_t)(page - 1);
+    hi &= ~(uintptr_t)(page - 1);
+    if (hi <= lo) return 0;
+
+    size_t resident = split ? resident_size((void*)lo, hi - lo) : 0;
+    madvise((void*)lo, hi - lo, MADV_DONTNEED);
+    return resident;
+}
+
+/* arena_free: coalesce with free physical neighbours (found through the boundary tags) and
+   put the result in its size bin. Caller holds arena->lock. */
+static void arena_free(arena_t *arena, common_header_t *block) {
+    if (!(block->flags & BLOCK_IN_USE)) return; /* double free */
+
+    if (MERGE_ENABLED) {
+        /* absorb the next block if it is free */
+        common_header_t *next = NEXT_BLOCK(block);
+        if (!(next->flags & BLOCK_IN_USE)) {
+            bin_remove(arena, next);
+            block->size += (int)(sizeof(common_header_t) + (size_t)next->size);
+        }
+
+        /* let a free previous block absorb this one */
+        if (block->flags & BLOCK_PREV_FREE) {
+            common_header_t *prev = PREV_BLOCK(block);
+            bin_remove(arena, prev);
+            prev->size += (int)(sizeof(common_header_t) + (size_t)block->size);
+            prev->flags &= ~BLOCK_PURGED;   /* block's pages are dirty */
+            block = prev;
+        }
+
+        if (arena_release_chunk(arena, block)) return;
+    }
+
+    block_set_free(block);
+    bin_insert(arena, block);
+    if (PURGE_EAGER_MIN && (size_t)block->size >= PURGE_EAGER_MIN) purge_block(block, 0);
+}
+
+/* Shrink an allocated block to payload n (rounded up to a block size), freeing the tail as its
+   own block when it is big enough to stand alone. Caller holds arena->lock. */
+static void arena_trim(arena_t *arena, common_header_t *block, size_t n) {
+    n = PAYLOAD_ROUND(n < (size_t)MIN_PAYLOAD ? (size_t)MIN_PAYLOAD : n);
+    int remainder = block->size - (int)n - (int)sizeof(common_header_t);
+    if (remainder < MIN_PAYLOAD) return;
+
+    common_header_t *tail = (common_header_t*)((uint8_t*)block + sizeof(common_header_t) + n);
+    tail->size = remainder;
+    tail->flags = BLOCK_IN_USE;
+    tail->tag = 0;
+    block->size = (int)n;
+    arena_free(arena, tail);    /* merges with a free successor */
+}
+
+/* Grow an allocated block in place to payload n by absorbing a free physical successor.
+   Caller holds arena->lock. Returns 0 if the successor is not free or not big enough. */
+static int arena_grow_in_place(arena_t *arena, common_header_t *block, size_t n) {
+    common_header_t *next = NEXT_BLOCK(block);
+    if (next->flags & BLOCK_IN_USE) return 0;
+    if ((size_t)block->size + sizeof(common_header_t) + (size_t)next->size < n) return 0;
+
+    bin_remove(arena, next);
+    block->size += (int)(sizeof(common_header_t) + (size_t)next->size);
+    block_set_used(block);      /* the new successor must not think we are free */
+    arena_trim(arena, block, n);
+    return 1;
+}
+
+/* Push a block on the arena's remote-free stack (lock-free, any number of producers) */
+static void remote_free_push(arena_t *arena, common_header_t *block) {
+    common_header_t *head = atomic_load_explicit(&arena->remote_free, memory_order_relaxed);
+    do {
+        FREE_LINKS(block)->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&arena->remote_free, &head, block,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+/* Lock an arena and merge back every block freed remotely since the last holder.
+   The consumer takes the whole stack in one exchange, so there is no ABA problem. */
+static void arena_lock(arena_t *arena) {
+    pthread_mutex_lock(&arena->lock);
+    common_header_t *block = atomic_exchange_explicit(&arena->remote_free, NULL, memory_order_acquire);
+    while (block != NULL) {
+        common_header_t *next = FREE_LINKS(block)->next;
+        arena_free(arena, block);
+        block = next;
+    }
+}
+
+/* Free a block without ever waiting: if another thread holds the arena lock, hand the block
+   to the holder (or the next one) through the remote-free stack */
+static void arena_free_nowait(arena_t *arena, common_header_t *block) {
+    if (pthread_mutex_trylock(&arena->lock) == 0) {
+        arena_free(arena, block);
+        pthread_mutex_unlock(&arena->lock);
     } else {
-        /* remove best from freelist */
-        if (best_prev == NULL) {
-            *arena_head = best->next;
-        } else {
-            best_prev->next = best->next;
+        remote_free_push(arena, block);
+    }
+}
+
+/* Return up to count blocks of a tcache bin to their arenas, trying each arena's lock once
+   per run; a busy arena gets its blocks through the remote-free stack instead */
+static void tcache_flush(int i, int count) {
+    arena_t *current = NULL;
+    int locked = 0;
+    while (count-- > 0 && tcache.bins[i] != NULL) {
+        common_header_t *block = tcache.bins[i];
+        tcache.bins[i] = FREE_LINKS(block)->next;
+        tcache.counts[i]--;
+
+        arena_t *arena = arena_for_ptr(block);
+        if (arena != current) {
+            if (locked) pthread_mutex_unlock(&current->lock);
+            current = arena;
+            locked = (pthread_mutex_trylock(&arena->lock) == 0);
+        }
+        if (locked) arena_free(arena, block);
+        else remote_free_push(arena, block);
+    }
+    if (locked) pthread_mutex_unlock(&current->lock);
+}
+
+/* Return up to count slots of a slab tcache bin to the slab tier under one class lock */
+static void tcache_slab_flush(int c, int count) {
+    void *batch[TCACHE_COUNT];
+    int k = 0;
+    while (k < count && k < TCACHE_COUNT && tcache.slab_bins[c] != NULL) {
+        batch[k] = tcache.slab_bins[c];
+        tcache.slab_bins[c] = *(void**)batch[k];
+        k++;
+    }
+    tcache.slab_counts[c] -= k;
+    slab_free_batch(c, batch, k);
+}
+
+/* Return every cached block of the calling thread to the arenas */
+void tcache_flush_all(void) {
+    for (int i = 0; i < TCACHE_BINS; i++) tcache_flush(i, tcache.counts[i]);
+    for (int c = 0; c < SLAB_CLASSES; c++) tcache_slab_flush(c, tcache.slab_counts[c]);
+}
+
+/* thread exit: give the dying thread's cached blocks back */
+static void tcache_destroy(void *unused) {
+    (void)unused;
+    tcache_flush_all();
+}
+
+/* first refill of a thread: make sure its cache is flushed when the thread exits */
+static void tcache_register(void) {
+    if (!tcache.registered) {
+        pthread_setspecific(tcache_key, &tcache);
+        tcache.registered = 1;
+    }
+}
+
+/* Refill slab tcache bin c with up to TCACHE_BATCH slots under one class lock */
+static int tcache_slab_refill(int c) {
+    void *batch[TCACHE_BATCH];
+    tcache_register();
+    int got = slab_alloc_batch(c, batch, TCACHE_BATCH);
+    for (int k = 0; k < got; k++) {
+        *(void**)batch[k] = tcache.slab_bins[c];
+        tcache.slab_bins[c] = batch[k];
+    }
+    tcache.slab_counts[c] += got;
+    return got > 0;
+}
+
+/* Refill tcache bin i with up to TCACHE_BATCH blocks of payload n under one arena lock.
+   If the arena is exhausted, flush this thread's cache into it and retry once. */
+static int tcache_refill(int i, size_t n) {
+    tcache_register();
+
+    arena_t *arena = arena_for_size(n);
+    arena_lock(arena);
+    for (int k = 0; k < TCACHE_BATCH; k++) {
+        common_header_t *block = arena_malloc(arena, n, 1);
+        if (block == NULL) break;
+        FREE_LINKS(block)->next = tcache.bins[i];
+        tcache.bins[i] = block;
+        tcache.counts[i]++;
+    }
+    pthread_mutex_unlock(&arena->lock);
+
+    if (tcache.bins[i] == NULL) {
+        tcache_flush_all();
+        common_header_t *block = arena_alloc(arena, n);
+        if (block == NULL) return 0;
+        FREE_LINKS(block)->next = NULL;
+        tcache.bins[i] = block;
+        tcache.counts[i] = 1;
+    }
+    return 1;
+}
+
+/* Purge every free block of every arena */
+size_t allocator_purge(void) {
+    arena_t *arenas[3] = { &arena_small, &arena_med, &arena_large };
+    size_t purged = 0;
+
+    init_arenas();
+    for (int a = 0; a < 3; a++) {
+        arena_lock(arenas[a]);
+        for (int fl = 0; fl < FL_COUNT; fl++) {
+            if (!(arenas[a]->fl_map & (1u << fl))) continue;
+            for (int sl = 0; sl < SL_COUNT; sl++) {
+                for (common_header_t *c = arenas[a]->bins[fl][sl]; c; c = FREE_LINKS(c)->next) purged += purge_block(c, 1);
+            }
+        }
+        pthread_mutex_unlock(&arenas[a]->lock);
+    }
+    return purged;
+}
+
+/* mapped vs resident bytes of the arena chunks and huge blocks */
+void allocator_mem_stats(size_t *mapped, size_t *resident) {
+    arena_t *arenas[3] = { &arena_small, &arena_med, &arena_large };
+    size_t m = 0, r = 0;
+
+    for (int a = 0; a < 3; a++) {
+        arena_lock(arenas[a]);
+        for (chunk_t *ch = arenas[a]->chunks; ch; ch = ch->next) {
+            m += ch->size;
+            r += resident_size(ch, ch->size);
+        }
+        pthread_mutex_unlock(&arenas[a]->lock);
+    }
+    pthread_mutex_lock(&huge_lock);
+    for (chunk_t *ch = huge_chunks; ch; ch = ch->next) {
+        m += ch->size;
+        r += resident_size(ch, ch->size);
+    }
+    pthread_mutex_unlock(&huge_lock);
+
+    if (mapped) *mapped = m;
+    if (resident) *resident = r;
+}
+
+/* Lock-free metrics snapshot: only reads counters the allocation paths keep up to date, so it
+   can be scraped at any rate without stalling allocation. Counters of different arenas are not
+   read atomically together. */
+static void snapshot_arena(arena_t *arena, arena_snapshot_t *out) {
+    out->chunk_size  = arena->chunk_size;
+    out->mapped      = atomic_load_explicit(&arena->mapped, memory_order_relaxed);
+    out->free_bytes  = atomic_load_explicit(&arena->free_bytes, memory_order_relaxed);
+    out->free_blocks = atomic_load_explicit(&arena->free_blocks, memory_order_relaxed);
+    out->spilled_in  = atomic_load_explicit(&arena->spilled_in, memory_order_relaxed);
+    out->spilled_out = atomic_load_explicit(&arena->spilled_out, memory_order_relaxed);
+}
+
+void allocator_snapshot(allocator_snapshot_t *snap) {
+    if (snap == NULL) return;
+    snapshot_arena(&arena_small, &snap->small);
+    snapshot_arena(&arena_med,   &snap->med);
+    snapshot_arena(&arena_large, &snap->large);
+    snap->huge_mapped = atomic_load_explicit(&huge_mapped, memory_order_relaxed);
+    snap->huge_blocks = atomic_load_explicit(&huge_blocks, memory_order_relaxed);
+    snap->mapped = atomic_load_explicit(&mapped_total, memory_order_relaxed);
+    snap->free_bytes = snap->small.free_bytes + snap->med.free_bytes + snap->large.free_bytes;
+    snap->free_blocks = snap->small.free_blocks + snap->med.free_blocks + snap->large.free_blocks;
+    snap->small_max = atomic_load_explicit(&small_max, memory_order_relaxed);
+    snap->med_max = atomic_load_explicit(&med_max, memory_order_relaxed);
+    snap->adaptations = atomic_load_explicit(&adaptations, memory_order_relaxed);
+}
+
+/* Huge block: its own CHUNK_ALIGN-aligned mapping with a chunk header (arena NULL, so sfree
+   recognises it through CHUNK_OF) and a block header recording the size. The payload starts at
+   the first align boundary after both headers. */
+static void *huge_malloc(size_t n, size_t align) {
+    size_t offset = (CHUNK_HDR + sizeof(common_header_t) + align - 1) & ~(align - 1);
+    size_t size = (offset + n + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+    if (size < n || offset >= CHUNK_ALIGN) return NULL; /* overflow, or unreachable by CHUNK_OF */
+    if (!map_reserve(size)) return NULL;
+
+    chunk_t *chunk = get_aligned_mem_block(size, CHUNK_ALIGN);
+    if (chunk == NULL) {
+        atomic_fetch_sub_explicit(&mapped_total, size, memory_order_relaxed);
+        return NULL;
+    }
+    int huge = thp_advise(chunk, size);    /* before the first touch faults in a small page */
+    chunk->arena = NULL;
+    chunk->size = size;
+    chunk->thp = huge;
+    pthread_mutex_lock(&huge_lock);
+    chunk_list_push(&huge_chunks, chunk);
+    COUNTER_ADD(huge_mapped, size);
+    COUNTER_ADD(huge_blocks, 1);
+    pthread_mutex_unlock(&huge_lock);
+
+    common_header_t *block = (common_header_t*)((uint8_t*)chunk + offset - sizeof(common_header_t));
+    block->size = (n > INT_MAX) ? INT_MAX : (int)n;   /* the exact size comes from chunk->size */
+    block->flags = BLOCK_IN_USE | BLOCK_MMAPPED;
+    block->tag = 0;
+    return (uint8_t*)block + sizeof(common_header_t);
+}
+
+static void huge_free(chunk_t *chunk) {
+    pthread_mutex_lock(&huge_lock);
+    chunk_list_remove(&huge_chunks, chunk);
+    COUNTER_SUB(huge_mapped, chunk->size);
+    COUNTER_SUB(huge_blocks, 1);
+    pthread_mutex_unlock(&huge_lock);
+    atomic_fetch_sub_explicit(&mapped_total, chunk->size, memory_order_relaxed);
+    munmap(chunk, chunk->size);
+}
+
+/* smalloc: tiny requests come from slab slots, small ones from the thread cache, huge ones
+   from their own mapping, the rest from the size-class arena. use_slab 0 skips the slab tier,
+   for blocks that need a header (sampled by the heap profiler). */
+static void *malloc_core(size_t n, int use_slab) {
+    if (n == 0) return NULL;
+
+    /* Ensure arenas exist */
+    init_arenas();
+
+    /* huge request (or one no chunk could hold): straight to mmap. Sizes the thread cache
+       handles never count as huge: a page-sized mapping per small block would waste it. */
+    if (n > TCACHE_MAX &&
+        (n >= MMAP_THRESHOLD || n > CHUNK_ALIGN - CHUNK_HDR - 2 * sizeof(common_header_t))) {
+        return huge_malloc(n, BLOCK_ALIGN);
+    }
+
+    if (n <= SLAB_MAX && use_slab) {
+        int c = slab_class(n);
+        if (tcache.slab_bins[c] != NULL || tcache_slab_refill(c)) {
+            void *slot = tcache.slab_bins[c];
+            tcache.slab_bins[c] = *(void**)slot;
+            tcache.slab_counts[c]--;
+            return slot;
         }
+        /* slab tier exhausted: fall back to the small arena */
+    }
+
+    if (n < (size_t)MIN_PAYLOAD) n = MIN_PAYLOAD; /* room for the free links once freed */
+    n = PAYLOAD_ROUND(n);                         /* keeps the next block's payload aligned */
+    if (--tcache.sample_left <= 0) size_sample(n);
+
+    common_header_t *block;
+    if (n <= TCACHE_MAX) {
+        int i = (int)(n / TCACHE_ALIGN);
+        if (tcache.bins[i] == NULL && !tcache_refill(i, n)) return NULL;
+        block = tcache.bins[i];
+        tcache.bins[i] = FREE_LINKS(block)->next;
+        tcache.counts[i]--;
+    } else {
+        /* Select arena */
+        block = arena_alloc(arena_for_size(n), n);
+        if (block == NULL) return NULL; /* no free block big enough anywhere */
     }
 
     /* return pointer to usable payload area */
-    return (uint8_t*)best + sizeof(common_header_t);
+    return (uint8_t*)block + sizeof(common_header_t);
 }
 
-/* sfree: insert block back into the right arena freelist and merge if enabled */
-void sfree(void *ptr) {
+/* sfree: slab slots and small blocks go to the thread cache (flushing half of a full bin),
+   huge blocks are unmapped, the rest go back to their arena without waiting on its lock */
+static void free_core(void *ptr) {
     if (ptr == NULL) return;
 
+    /* header-less slab slot: the size class comes from the slab's page */
+    if (slab_owns(ptr)) {
+        int c = slab_class_of(ptr);
+        if (tcache.slab_counts[c] >= TCACHE_COUNT) tcache_slab_flush(c, TCACHE_BATCH);
+        *(void**)ptr = tcache.slab_bins[c];
+        tcache.slab_bins[c] = ptr;
+        tcache.slab_counts[c]++;
+        return;
+    }
+
     /* compute header address */
     common_header_t *block = (common_header_t*)((uint8_t*)ptr - sizeof(common_header_t));
+    if (__builtin_expect(block->tag == BLOCK_TAG_SAMPLED, 0)) {
+        block->tag = 0;
+        prof_forget(ptr);
+    }
 
-    /* find which arena this pointer belongs to */
-    common_header_t **arena_head = arena_head_for_ptr(ptr);
+    /* a huge block is unmapped whatever its recorded size: an aligned request can map its
+       own chunk for a payload the thread cache would otherwise take */
+    arena_t *arena = arena_for_ptr(ptr);
+    if (arena == NULL) {
+        huge_free(CHUNK_OF(ptr));
+        return;
+    }
 
-    /* insert sorted into that freelist, receive prev node */
-    common_header_t *prev = insert_sorted_and_return_prev(block, arena_head);
+    /* block->size is stable while we own the block; flags are not (neighbours update
+       BLOCK_PREV_FREE under the arena lock), so they are only read under the lock */
+    if (block->size <= TCACHE_MAX) {
+        int i = block->size / TCACHE_ALIGN;
+        if (tcache.counts[i] >= TCACHE_COUNT) tcache_flush(i, TCACHE_BATCH);
+        FREE_LINKS(block)->next = tcache.bins[i];
+        tcache.bins[i] = block;
+        tcache.counts[i]++;
+        return;
+    }
 
-    if (MERGE_ENABLED) {
-        /* try merge with next (block->next may have changed) */
-        try_merge_with_next(block);
+    arena_free_nowait(arena, block);
+}
+
+/* smalloc_batch: count blocks of payload n with each lock taken once. Slab slots come from the
+   thread cache, then from the slab class in one batch; arena blocks from the thread cache, then
+   from runs carved under one arena lock, and only when the arena is exhausted one by one (with
+   spilling). Returns the number of out[] entries filled. */
+static size_t malloc_batch_core(size_t n, size_t count, void **out) {
+    if (n == 0 || count == 0) return 0;
+    init_arenas();
 
-        /* if there is a previous node, try merging prev with its next */
-        if (prev != NULL) {
-            try_merge_prev_with_next(prev);
+    size_t got = 0;
+    if (n > TCACHE_MAX &&
+        (n >= MMAP_THRESHOLD || n > CHUNK_ALIGN - CHUNK_HDR - 2 * sizeof(common_header_t))) {
+        while (got < count && (out[got] = huge_malloc(n, BLOCK_ALIGN)) != NULL) got++;
+        return got;
+    }
+
+    if (n <= SLAB_MAX) {
+        int c = slab_class(n);
+        while (got < count && tcache.slab_bins[c] != NULL) {
+            out[got] = tcache.slab_bins[c];
+            tcache.slab_bins[c] = *(void**)out[got++];
+            tcache.slab_counts[c]--;
+        }
+        while (got < count) {
+            size_t want = count - got;
+            int k = slab_alloc_batch(c, out + got, want > INT_MAX ? INT_MAX : (int)want);
+            if (k == 0) break;      /* slab tier exhausted: the rest come from the small arena */
+            got += (size_t)k;
+        }
+        if (got == count) return got;
+    }
+
+    if (n < (size_t)MIN_PAYLOAD) n = MIN_PAYLOAD;
+    n = PAYLOAD_ROUND(n);   /* keeps every payload of a run aligned */
+    tcache.sample_left -= (count - got < ADAPT_SAMPLE) ? (int)(count - got) : ADAPT_SAMPLE;
+    if (tcache.sample_left <= 0) size_sample(n);
+
+    if (n <= TCACHE_MAX) {
+        int i = (int)(n / TCACHE_ALIGN);
+        while (got < count && tcache.bins[i] != NULL) {
+            common_header_t *block = tcache.bins[i];
+            tcache.bins[i] = FREE_LINKS(block)->next;
+            tcache.counts[i]--;
+            out[got++] = (uint8_t*)block + sizeof(common_header_t);
+        }
+    }
+
+    arena_t *arena = arena_for_size(n);
+    arena_lock(arena);
+    while (got < count) {
+        size_t k = arena_malloc_run(arena, n, count - got, out + got);
+        if (k == 0) break;
+        got += k;
+    }
+    pthread_mutex_unlock(&arena->lock);
+
+    while (got < count) {
+        common_header_t *block = arena_alloc(arena, n);
+        if (block == NULL) break;
+        out[got++] = (uint8_t*)block + sizeof(common_header_t);
+    }
+    return got;
+}
+
+/* sfree_batch: group the pointers by owner and release each group under one lock hold: slab
+   slots per size class, arena blocks (chained through their header) per arena, where the
+   neighbours freed together coalesce in the same pass. Nothing goes through the thread cache. */
+static void free_batch_core(void **ptrs, size_t count) {
+    arena_t *arenas[3] = { &arena_small, &arena_med, &arena_large };
+    common_header_t *freed[3] = { NULL, NULL, NULL };
+    void *slots[SLAB_CLASSES] = { NULL };
+
+    for (size_t k = 0; k < count; k++) {
+        void *ptr = ptrs[k];
+        if (ptr == NULL) continue;
+        if (slab_owns(ptr)) {
+            int c = slab_class_of(ptr);
+            *(void**)ptr = slots[c];
+            slots[c] = ptr;
+            continue;
+        }
+        arena_t *arena = arena_for_ptr(ptr);
+        if (arena == NULL) {
+            if (((common_header_t*)((uint8_t*)ptr - sizeof(common_header_t)))->tag == BLOCK_TAG_SAMPLED) prof_forget(ptr);
+            huge_free(CHUNK_OF(ptr));
+            continue;
+        }
+        int a = (arena == &arena_small) ? 0 : (arena == &arena_med) ? 1 : 2;
+        common_header_t *block = (common_header_t*)((uint8_t*)ptr - sizeof(common_header_t));
+        if (block->tag == BLOCK_TAG_SAMPLED) {
+            block->tag = 0;
+            prof_forget(ptr);
+        }
+        FREE_LINKS(block)->next = freed[a];
+        freed[a] = block;
+    }
+
+    for (int c = 0; c < SLAB_CLASSES; c++) {
+        void *batch[TCACHE_COUNT];
+        while (slots[c] != NULL) {
+            int k = 0;
+            while (k < TCACHE_COUNT && slots[c] != NULL) {
+                batch[k++] = slots[c];
+                slots[c] = *(void**)slots[c];
+            }
+            slab_free_batch(c, batch, k);
+        }
+    }
+
+    for (int a = 0; a < 3; a++) {
+        if (freed[a] == NULL) continue;
+        arena_lock(arenas[a]);
+        while (freed[a] != NULL) {
+            common_header_t *block = freed[a];
+            freed[a] = FREE_LINKS(block)->next;
+            arena_free(arenas[a], block);
         }
+        pthread_mutex_unlock(&arenas[a]->lock);
     }
 }
+
+/* heap profiler hook (see prof.h): a sampled block carries BLOCK_TAG_SAMPLED in its header tag,
+   which only the owner writes, so free_core spots it on the header line it reads anyway. Slab slots have no header: sampled requests skip the slab tier (malloc_core(n, 0)), and
+   a slot returned by srealloc or smalloc_batch loses its sample. Not inlined, so the backtrace
+   always starts PROF_SKIP frames above the caller. */
+static __attribute__((noinline)) void prof_take(void *ptr, size_t n) {
+    if (ptr == NULL || slab_owns(ptr)) return;
+    prof_record(ptr, n);
+    ((common_header_t*)((uint8_t*)ptr - sizeof(common_header_t)))->tag = BLOCK_TAG_SAMPLED;
+}
+
+/* public entry points: the *_core functions plus the trace hook (see trace.h) and the heap
+   profiler's byte countdown. A free is recorded before it happens, so no other thread can
+   record the same address first */
+void *smalloc(size_t n) {
+    void *p;
+    if (PROF_SAMPLE(n)) {
+        p = malloc_core(n, 0);
+        prof_take(p, n);
+    } else {
+        p = malloc_core(n, 1);
+    }
+    if (TRACE_ON()) trace_event(TRACE_MALLOC, p, n, 0);
+    return p;
+}
+
+void sfree(void *ptr) {
+    if (ptr != NULL && TRACE_ON()) trace_event(TRACE_FREE, ptr, 0, 0);
+    free_core(ptr);
+}
+
+size_t smalloc_batch(size_t n, size_t count, void **out) {
+    size_t got = malloc_batch_core(n, count, out);
+    if (got > 0 && PROF_SAMPLE(n * got)) prof_take(out[0], n);   /* one sample per batch at most */
+    if (TRACE_ON()) {
+        for (size_t k = 0; k < got; k++) trace_event(TRACE_MALLOC, out[k], n, 0);
+    }
+    return got;
+}
+
+void sfree_batch(void **ptrs, size_t count) {
+    if (TRACE_ON()) {
+        for (size_t k = 0; k < count; k++) {
+            if (ptrs[k] != NULL) trace_event(TRACE_FREE, ptrs[k], 0, 0);
+        }
+    }
+    free_batch_core(ptrs, count);
+}
+
+/* usable payload bytes of an allocated pointer (at least what was requested) */
+size_t susable_size(void *ptr) {
+    if (ptr == NULL) return 0;
+    if (slab_owns(ptr)) return slab_class_size(slab_class_of(ptr));
+
+    chunk_t *chunk = CHUNK_OF(ptr);
+    if (chunk->arena == NULL) return chunk->size - (size_t)((uint8_t*)ptr - (uint8_t*)chunk);
+
+    common_header_t *block = (common_header_t*)((uint8_t*)ptr - sizeof(common_header_t));
+    return (size_t)block->size;
+}
+
+/* srealloc: keep the block when it is already big enough, grow arena blocks in place into a free
+   successor when possible, and only otherwise allocate, copy and free */
+static void *realloc_core(void *ptr, size_t n) {
+    size_t usable = susable_size(ptr);
+    if (n <= usable) {
+        arena_t *arena = slab_owns(ptr) ? NULL : CHUNK_OF(ptr)->arena;
+        if (arena != NULL && usable > TCACHE_MAX) {   /* give a big enough tail back */
+            arena_lock(arena);
+            arena_trim(arena, (common_header_t*)((uint8_t*)ptr - sizeof(common_header_t)), n);
+            pthread_mutex_unlock(&arena->lock);
+        }
+        return ptr;
+    }
+
+    if (!slab_owns(ptr) && CHUNK_OF(ptr)->arena != NULL) {
+        arena_t *arena = CHUNK_OF(ptr)->arena;
+        arena_lock(arena);
+        int grown = arena_grow_in_place(arena, (common_header_t*)((uint8_t*)ptr - sizeof(common_header_t)), n);
+        pthread_mutex_unlock(&arena->lock);
+        if (grown) return ptr;
+    }
+
+    void *p = malloc_core(n, 1);
+    if (p == NULL) return NULL;     /* the old block stays valid */
+    memcpy(p, ptr, usable);
+    free_core(ptr);
+    return p;
+}
+
+void *srealloc(void *ptr, size_t n) {
+    if (ptr == NULL) return smalloc(n);
+    if (n == 0) { sfree(ptr); return NULL; }
+
+    void *p = realloc_core(ptr, n);
+    /* a block kept in place ends its old sample; a moved one was released by free_core */
+    if (p == ptr && !slab_owns(p)) {
+        common_header_t *block = (common_header_t*)((uint8_t*)p - sizeof(common_header_t));
+        if (block->tag == BLOCK_TAG_SAMPLED) {
+            block->tag = 0;
+            prof_forget(p);
+        }
+    }
+    if (p != NULL && PROF_SAMPLE(n)) prof_take(p, n);
+    if (TRACE_ON()) trace_realloc(ptr, p, n);
+    return p;
+}
+
+/* scalloc: zeroed array allocation. Huge blocks come from fresh anonymous mappings, which the
+   kernel already zeroed, so only arena and slab memory is cleared. */
+void *scalloc(size_t nmemb, size_t size) {
+    if (size != 0 && nmemb > (size_t)-1 / size) return NULL; /* overflow */
+    size_t n = nmemb * size;
+    void *p;
+    if (PROF_SAMPLE(n)) {
+        p = malloc_core(n, 0);
+        prof_take(p, n);
+    } else {
+        p = malloc_core(n, 1);
+    }
+    if (TRACE_ON()) trace_event(TRACE_CALLOC, p, n, 0);
+    if (p == NULL) return NULL;
+    if (slab_owns(p) || CHUNK_OF(p)->arena != NULL) memset(p, 0, n);
+    return p;
+}
+
+/* saligned_alloc: payload aligned to a power of two. Over-allocates from the arena, then frees
+   the gap in front of the aligned address and the tail as separate free blocks. */
+static void *aligned_core(size_t alignment, size_t n) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) return NULL;
+    if (n == 0) return NULL;
+    if (alignment < BLOCK_ALIGN) alignment = BLOCK_ALIGN;
+    if (n < (size_t)MIN_PAYLOAD) n = MIN_PAYLOAD;
+
+    init_arenas();
+
+    /* worst case: a gap of alignment - 1, grown by one alignment if it cannot hold a free block */
+    size_t padded = PAYLOAD_ROUND(n + 2 * alignment + sizeof(common_header_t) + MIN_PAYLOAD);
+    if (padded < n) return NULL; /* overflow */
+    if (padded >= MMAP_THRESHOLD || padded > CHUNK_ALIGN - CHUNK_HDR - 2 * sizeof(common_header_t)) {
+        return huge_malloc(n, alignment);
+    }
+
+    common_header_t *block = arena_alloc(arena_for_size(padded), padded);
+    if (block == NULL) return NULL;
+    arena_t *arena = arena_for_ptr(block);     /* may be a neighbour the request spilled to */
+    arena_lock(arena);
+
+    uintptr_t payload = (uintptr_t)block + sizeof(common_header_t);
+    uintptr_t aligned = (payload + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if (aligned != payload) {
+        while (aligned - payload < sizeof(common_header_t) + MIN_PAYLOAD) aligned += alignment;
+
+        /* front gap becomes its own (freed) block in front of the aligned one */
+        common_header_t *front = block;
+        block = (common_header_t*)(aligned - sizeof(common_header_t));
+        block->size = front->size - (int)(aligned - payload);
+        block->flags = BLOCK_IN_USE;
+        block->tag = 0;
+        front->size = (int)(aligned - payload - sizeof(common_header_t));
+        arena_free(arena, front);
+    }
+    arena_trim(arena, block, n);
+    pthread_mutex_unlock(&arena->lock);
+    return (void*)aligned;
+}
+
+void *saligned_alloc(size_t alignment, size_t n) {
+    void *p = aligned_core(alignment, n);
+    if (p != NULL && PROF_SAMPLE(n)) prof_take(p, n);
+    if (TRACE_ON()) trace_event(TRACE_ALIGNED, p, n, alignment ? __builtin_ctzl(alignment) : 0);
+    return p;
+}
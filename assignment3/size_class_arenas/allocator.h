@@ -2,38 +2,155 @@
 #define ALLOCATOR_H
 
 #include <stddef.h>
+#ifdef __cplusplus
+extern "C" {            // C++ users (smalloc_resource.hpp) only get the API; the internals are C11
+#else
 #include "freelist.h"   // defines common_header_t and extern freelist heads
+#endif
 
-#define MEM_SIZE (10*1024*1024)
+#define MEM_SIZE (10*1024*1024)    // initial arena memory (the slab tier has its own SLAB_HEAP)
 
 // fit strategy and merge toggle 
 #define FIRST_FIT 1
 #define BEST_FIT 2
+#define TLSF_FIT 3      // two-level segregated fit: O(1) good-fit from the size bins
 
 extern int FIT_STRATEGY;
 extern int MERGE_ENABLED;
 
-// size-class boundaries
+// payloads of at least MMAP_THRESHOLD bytes bypass the arenas: each gets its own mapping,
+// unmapped again by sfree
+extern size_t MMAP_THRESHOLD;
+
+// purging: the page-aligned interior of free blocks is returned to the OS with madvise, either
+// on demand (allocator_purge) or eagerly when sfree leaves a free block of PURGE_EAGER_MIN bytes
+// or more (0 = never purge eagerly)
+extern size_t PURGE_EAGER_MIN;
+
+// default size-class boundaries (SMALL_MAX / MED_MAX can also be overridden with -D; at run
+// time see allocator_config)
+#define SLAB_MAX    256         // header-less slab slots up to here (see slab.h)
+#ifndef SMALL_MAX
 #define SMALL_MAX   14*1024
+#endif
+#ifndef MED_MAX
 #define MED_MAX     25*1024
-// class memory capacity
+#endif
+// class memory capacity (defaults): each arena starts with one chunk of its *_HEAP size and maps another
+// one whenever it has no fit. Chunks are aligned to CHUNK_ALIGN, so the chunk (and arena) owning
+// a block is found by masking the block's address.
+#define SLAB_HEAP   (1*1024*1024)
 #define SMALL_HEAP  (2*1024*1024)
 #define MED_HEAP    (4*1024*1024)
 #define LARGE_HEAP  (4*1024*1024)
+#define CHUNK_ALIGN (4*1024*1024)   // >= every *_HEAP, and the largest chunk size
+
+// transparent huge pages (config option thp): arena chunks are rounded up to whole HUGE_PAGEs
+// (their CHUNK_ALIGN alignment already is a multiple) and advised MADV_HUGEPAGE, as are huge
+// blocks of at least HUGE_PAGE, so the kernel backs them with 2 MB pages and large working sets
+// take far fewer TLB misses. The eager purge then only hands back whole huge pages, since a
+// partial one would split the page; allocator_purge still returns every whole small page. If the
+// kernel has no THP support the option turns itself off.
+#define HUGE_PAGE   (2*1024*1024)
+
+// per-thread caches: slab slots, and payloads up to TCACHE_MAX (one bin per TCACHE_ALIGN), are
+// served from thread-local bins; the shared lock is only taken to refill or flush TCACHE_BATCH blocks
+#define TCACHE_MAX    1024
+#define TCACHE_ALIGN  16
+#define TCACHE_COUNT  16      // blocks held per bin before a flush
+#define TCACHE_BATCH  8       // blocks moved per refill / flush
+
+// adaptive boundaries (config option adaptive): 1 in ADAPT_SAMPLE arena-bound requests per thread
+// is sampled, and every ADAPT_PERIOD samples the boundaries and next chunk sizes are recomputed
+#define ADAPT_SAMPLE  64
+#define ADAPT_PERIOD  4096
 
-// public allocator API
+// runtime configuration, so services can be tuned and benchmarks swept without rebuilding.
+// Defaults come from the macros above; SMALLOC_CONF (read once, on first use) overrides them
+// and allocator_config() overrides both. Chunk sizes apply to chunks mapped afterwards, so set
+// them before the first allocation. Meant to be changed while no other thread allocates.
+//   SMALLOC_CONF="fit:tlsf,merge:1,arenas:3,small_max:8K,med_max:64K,small_heap:1M,
+//                 med_heap:2M,large_heap:4M,mmap_threshold:256K,purge:1M,adaptive:1,
+//                 spill:full,heap_limit:64M,thp:1"   (purge:off = 0, spill:off|full|eager)
+#define SPILL_OFF        0      // a request is only ever served by its own arena
+#define SPILL_WHEN_FULL  1      // ... or by a neighbour once its arena has no fit and cannot grow
+#define SPILL_EAGER      2      // ... or by a neighbour's free blocks before its arena grows
+
+typedef struct allocator_config {
+    int fit_strategy;           // FIRST_FIT, BEST_FIT or TLSF_FIT
+    int merge_enabled;
+    int arenas;                 // size classes in use: 3, 2 (small + large) or 1 (large only)
+    size_t small_max;           // payloads up to here go to the small arena
+    size_t med_max;             // ... up to here to the medium one, the rest to the large one
+    size_t small_heap, med_heap, large_heap;    // chunk sizes: 64 KB .. CHUNK_ALIGN, page multiples
+    size_t mmap_threshold;      // see MMAP_THRESHOLD
+    size_t purge_eager_min;     // see PURGE_EAGER_MIN
+    int adaptive;               // learn small_max / med_max and chunk sizes from the traffic
+    int spill;                  // SPILL_* (default SPILL_WHEN_FULL)
+    size_t heap_limit;          // cap on the bytes mapped by arena chunks and huge blocks (0 = none)
+    int thp;                    // back chunks with transparent huge pages (see HUGE_PAGE)
+} allocator_config_t;
+
+void allocator_get_config(allocator_config_t *cfg);
+int allocator_config(const allocator_config_t *cfg);    // 0, or -1 (nothing changed) if invalid
+int allocator_config_parse(const char *conf);           // SMALLOC_CONF syntax; returns options applied
+
+// public allocator API (thread-safe). Every pointer returned is SMALLOC_ALIGN aligned.
+#define SMALLOC_ALIGN 16        // alignof(max_align_t) on x86-64; the arenas' BLOCK_ALIGN
 void *smalloc(size_t n);
 void sfree(void *ptr);
+void *srealloc(void *ptr, size_t n);
+void *scalloc(size_t nmemb, size_t size);
+void *saligned_alloc(size_t alignment, size_t n);
+size_t susable_size(void *ptr);
+// bursts of same-size objects: each lock is taken once per batch and arena blocks are carved
+// from one free block with a single split. smalloc_batch returns how many of out[0..count) it
+// filled (fewer only when memory runs out); sfree_batch frees every non-NULL entry.
+size_t smalloc_batch(size_t n, size_t count, void **out);
+void sfree_batch(void **ptrs, size_t count);
+void tcache_flush_all(void);    // return the calling thread's cached blocks to the arenas
 
 void *get_mem_block(void *addr, size_t mem_size);
+void *get_aligned_mem_block(size_t mem_size, size_t align);
 
 void init_arenas(void);
 
 // utility functions used by the test 
 size_t allocator_req_mem(size_t payload);
 size_t allocator_free_mem_size(void);
+size_t allocator_mapped_size(void);    // arena chunks + huge mappings
+size_t allocator_purge(void);           // returns the resident bytes handed back to the OS
+void allocator_mem_stats(size_t *mapped, size_t *resident);   // same scope as allocator_mapped_size
 void allocator_list_dump(void);
 
-void allocator_stats(size_t* N, size_t* F, size_t* L);  // stress test
+void allocator_stats(size_t* N, size_t* F, size_t* L);  // stress test (O(1) but for the scan of the top bin)
+
+// cheap metrics snapshot: counters maintained by smalloc / sfree, read without any lock.
+// Free bytes / blocks are those in the arena bins (blocks held by thread caches count as used).
+typedef struct arena_snapshot {
+    size_t chunk_size;      // size of the next chunk it maps
+    size_t mapped;          // bytes mapped by the arena's chunks
+    size_t free_bytes;      // payload bytes of its free blocks
+    size_t free_blocks;
+    size_t spilled_in;      // requests of other arenas it served
+    size_t spilled_out;     // its requests served by another arena
+} arena_snapshot_t;
+
+typedef struct allocator_snapshot {
+    arena_snapshot_t small, med, large;
+    size_t huge_mapped;     // bytes mapped by huge blocks
+    size_t huge_blocks;
+    size_t mapped;          // arenas + huge blocks
+    size_t free_bytes;      // sum over the arenas
+    size_t free_blocks;
+    size_t small_max, med_max;  // current boundaries
+    size_t adaptations;     // boundary recomputations so far
+} allocator_snapshot_t;
+
+void allocator_snapshot(allocator_snapshot_t *snap);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
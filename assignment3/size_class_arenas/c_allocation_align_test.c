@@ -0,0 +1,200 @@
+/**
+ * READ ME
+ * This is a test of the 16-byte alignment guarantee (SMALLOC_ALIGN) and of the per-block cost
+ * of the 8-byte block header
+ * - Every allocation path is driven with random sizes and every returned pointer is checked
+ *   for 16-byte alignment: smalloc (slab, thread-cache, arena and huge sizes), scalloc, srealloc
+ *   chains, saligned_alloc (alignments 16 to 65536) and smalloc_batch. The largest alignments
+ *   pad even small requests past MMAP_THRESHOLD, so small blocks get their own mapping; each
+ *   path ends with tcache_flush_all, which must never meet such a block in the thread cache. Each buffer is filled and
+ *   read back with aligned SSE loads (_mm_load_si128), which fault on a misaligned address.
+ * - Then N_OBJECTS objects of each size in sizes[] (arena sizes; slab slots carry no header) are
+ *   kept live, and the bytes they take from the arenas (mapped bytes less free bytes) are
+ *   divided by the count: the request itself plus header and rounding.
+ * - Reports misaligned pointers and corrupted buffers per path (should be 0), and bytes and
+ *   overhead per object for each size.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "allocator.h"   // smalloc, scalloc, srealloc, saligned_alloc, smalloc_batch, tcache_flush_all, allocator_stats
+
+// Tunable Parameters
+#define OPS          200000     // allocations per path
+#define LIVE         1024       // objects kept alive per path (random replacement)
+#define MAX_ARENA    (64 * 1024)
+#define MAX_HUGE     (1024 * 1024)
+#define HUGE_EVERY   64         // one huge size every HUGE_EVERY smalloc calls
+#define BATCH        32
+#define N_OBJECTS    20000      // live objects per size for the overhead measurement
+
+static const size_t sizes[] = { 264, 300, 520, 1000, 4000, 20000 };
+
+enum { P_SMALLOC, P_SCALLOC, P_SREALLOC, P_ALIGNED, P_BATCH, N_PATHS };
+static const char *path_names[N_PATHS] = { "smalloc", "scalloc", "srealloc", "saligned_alloc", "smalloc_batch" };
+static size_t misaligned[N_PATHS], corrupted[N_PATHS], checked[N_PATHS];
+
+static void *live[LIVE];
+static size_t live_size[LIVE];
+
+static inline uint64_t xorshift(uint64_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+// random request size: mostly slab and thread-cache sizes, some arena sizes, now and then a huge one
+static size_t random_size(uint64_t *seed, int allow_huge) {
+    uint64_t r = xorshift(seed);
+    if (allow_huge && r % HUGE_EVERY == 0) return (size_t)(r >> 8) % MAX_HUGE + 1;
+    switch (r % 4) {
+    case 0:  return (size_t)(r >> 8) % 256 + 1;
+    case 1:  return (size_t)(r >> 8) % 1024 + 1;
+    default: return (size_t)(r >> 8) % MAX_ARENA + 1;
+    }
+}
+
+// fill the first n bytes of p with a stamp, in aligned 16-byte stores where SSE2 is available
+static void stamp(void *p, size_t n, uint8_t v) {
+#ifdef __SSE2__
+    __m128i x = _mm_set1_epi8((char)v);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) _mm_store_si128((__m128i*)((uint8_t*)p + i), x);
+    memset((uint8_t*)p + i, v, n - i);
+#else
+    memset(p, v, n);
+#endif
+}
+
+// read the stamp back, in aligned 16-byte loads where SSE2 is available
+static int stamp_ok(const void *p, size_t n, uint8_t v) {
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i x = _mm_set1_epi8((char)v);
+    for (; i + 16 <= n; i += 16) {
+        __m128i y = _mm_load_si128((const __m128i*)((const uint8_t*)p + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff) return 0;
+    }
+#endif
+    for (; i < n; i++) if (((const uint8_t*)p)[i] != v) return 0;
+    return 1;
+}
+
+// check a fresh pointer of path path, stamp it, and put it in slot k (freeing what was there)
+static void keep(int path, size_t k, void *p, size_t n) {
+    if (p == NULL) return;
+    checked[path]++;
+    if ((uintptr_t)p % SMALLOC_ALIGN != 0) { misaligned[path]++; sfree(p); return; }
+    if (live[k] != NULL) {
+        if (!stamp_ok(live[k], live_size[k], (uint8_t)k)) corrupted[path]++;
+        sfree(live[k]);
+    }
+    stamp(p, n, (uint8_t)k);
+    live[k] = p;
+    live_size[k] = n;
+}
+
+static void drop_all(int path) {
+    for (size_t k = 0; k < LIVE; k++) {
+        if (live[k] == NULL) continue;
+        if (!stamp_ok(live[k], live_size[k], (uint8_t)k)) corrupted[path]++;
+        sfree(live[k]);
+        live[k] = NULL;
+    }
+    tcache_flush_all();
+}
+
+static void run_path(int path, uint64_t *seed) {
+    for (int i = 0; i < OPS; i++) {
+        size_t k = (size_t)(xorshift(seed) % LIVE);
+        size_t n = random_size(seed, 1);
+        switch (path) {
+        case P_SMALLOC:
+            keep(path, k, smalloc(n), n);
+            break;
+        case P_SCALLOC: {
+            uint8_t *p = scalloc(1, n);
+            if (p != NULL && !stamp_ok(p, n, 0)) corrupted[path]++;
+            keep(path, k, p, n);
+            break;
+        }
+        case P_SREALLOC: {       // grow or shrink the object in slot k, keeping its contents
+            if (live[k] == NULL) { keep(path, k, smalloc(n), n); break; }
+            size_t old = live_size[k];
+            uint8_t *p = srealloc(live[k], n);
+            if (p == NULL) break;
+            live[k] = NULL;
+            checked[path]++;
+            if ((uintptr_t)p % SMALLOC_ALIGN != 0) misaligned[path]++;
+            if (!stamp_ok(p, old < n ? old : n, (uint8_t)k)) corrupted[path]++;
+            stamp(p, n, (uint8_t)k);
+            live[k] = p;
+            live_size[k] = n;
+            break;
+        }
+        case P_ALIGNED: {
+            size_t align = (size_t)16 << (xorshift(seed) % 13);    // 16 .. 65536
+            uint8_t *p = saligned_alloc(align, n);
+            if (p != NULL && (uintptr_t)p % align != 0) misaligned[path]++;
+            keep(path, k, p, n);
+            break;
+        }
+        case P_BATCH: {
+            void *out[BATCH];
+            n = random_size(seed, 0);
+            size_t got = smalloc_batch(n, BATCH, out);
+            for (size_t j = 0; j < got; j++) keep(path, (k + j) % LIVE, out[j], n);
+            i += BATCH - 1;
+            break;
+        }
+        }
+    }
+    drop_all(path);
+}
+
+// bytes taken from the arenas per live object of size n
+static double bytes_per_object(size_t n) {
+    static void *objs[N_OBJECTS];
+    size_t N, F, L;
+    allocator_stats(&N, &F, &L);
+    size_t mapped0 = allocator_mapped_size(), free0 = F;
+    for (int i = 0; i < N_OBJECTS; i++) objs[i] = smalloc(n);
+    allocator_stats(&N, &F, &L);
+    double used = (double)(allocator_mapped_size() - mapped0) - ((double)F - (double)free0);
+    for (int i = 0; i < N_OBJECTS; i++) sfree(objs[i]);
+    tcache_flush_all();
+    return used / N_OBJECTS;
+}
+
+int main(void) {
+    uint64_t seed = 88172645463325252ull;
+    for (int path = 0; path < N_PATHS; path++) run_path(path, &seed);
+
+    printf("\n%d allocations per path, sizes up to %d KB (every %dth up to %d KB): \n",
+           OPS, MAX_ARENA / 1024, HUGE_EVERY, MAX_HUGE / 1024);
+    printf("\t%-16s %10s %12s %10s\n", "path", "checked", "misaligned", "corrupted");
+    size_t bad = 0;
+    for (int path = 0; path < N_PATHS; path++) {
+        printf("\t%-16s %10zu %12zu %10zu\n", path_names[path], checked[path], misaligned[path], corrupted[path]);
+        bad += misaligned[path] + corrupted[path];
+    }
+#ifndef __SSE2__
+    printf("\t(no SSE2: buffers checked with plain byte loads)\n");
+#endif
+
+    printf("\nArena bytes per live object (%d objects per size): \n", N_OBJECTS);
+    printf("\t%10s %12s %10s\n", "request", "bytes", "overhead");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        double b = bytes_per_object(sizes[s]);
+        printf("\t%10zu %12.1f %10.1f\n", sizes[s], b, b - (double)sizes[s]);
+    }
+    printf("\n");
+    return bad != 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * READ ME
+ * This is a benchmark of the batch API (smalloc_batch / sfree_batch) against one smalloc /
+ * sfree call per object
+ * - Models a message pipeline: every round allocates a burst of BURST_MIN..BURST_MAX messages of
+ *   one size, and frees the burst allocated IN_FLIGHT rounds earlier (a FIFO of bursts).
+ * - Runs ROUNDS rounds for each message size in sizes[] (slab, thread-cache, and arena sizes),
+ *   once with per-object calls and once with the batch calls, on the same random bursts.
+ * - Every message is stamped on allocation and checked before it is freed.
+ * - Reports ns per message (one alloc + one free) for both, and corrupted messages (should be 0).
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "allocator.h"   // smalloc, sfree, smalloc_batch, sfree_batch
+
+// Tunable Parameters
+#define ROUNDS      20000       // bursts per message size
+#define BURST_MIN   32
+#define BURST_MAX   256
+#define IN_FLIGHT   4           // bursts alive at a time
+
+static const size_t sizes[] = { 48, 200, 1000, 4000, 16000 };
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void *burst[IN_FLIGHT][BURST_MAX];
+static size_t burst_len[IN_FLIGHT];
+
+// check and free the burst in slot b
+static size_t drain(int b, int batch) {
+    size_t corrupted = 0;
+    for (size_t k = 0; k < burst_len[b]; ++k) {
+        uint64_t *m = burst[b][k];
+        if (m && *m != ((uint64_t)b << 32 | k)) corrupted++;
+        if (!batch) sfree(m);
+    }
+    if (batch) sfree_batch(burst[b], burst_len[b]);
+    burst_len[b] = 0;
+    return corrupted;
+}
+
+// ns per message of one run over ROUNDS bursts of size-byte messages
+static double run(size_t size, int batch, size_t *corrupted) {
+    unsigned seed = 7;
+    size_t messages = 0;
+
+    uint64_t start = now_ns();
+    for (int r = 0; r < ROUNDS; ++r) {
+        int b = r % IN_FLIGHT;
+        *corrupted += drain(b, batch);
+
+        size_t n = BURST_MIN + (size_t)rand_r(&seed) % (BURST_MAX - BURST_MIN + 1);
+        if (batch) {
+            size_t got = smalloc_batch(size, n, burst[b]);
+            for (size_t k = got; k < n; ++k) burst[b][k] = NULL;
+        } else {
+            for (size_t k = 0; k < n; ++k) burst[b][k] = smalloc(size);
+        }
+        for (size_t k = 0; k < n; ++k) {
+            uint64_t *m = burst[b][k];
+            if (m) { *m = (uint64_t)b << 32 | k; ((char*)m)[size - 1] = 1; }
+        }
+        burst_len[b] = n;
+        messages += n;
+    }
+    for (int b = 0; b < IN_FLIGHT; ++b) *corrupted += drain(b, batch);
+    return (double)(now_ns() - start) / (double)messages;
+}
+
+int main(void) {
+    size_t corrupted = 0;
+
+    printf("\nBurst allocation, %d..%d messages per burst, %d bursts in flight: \n", BURST_MIN, BURST_MAX, IN_FLIGHT);
+    printf("\t%10s %18s %18s\n", "size", "smalloc / sfree", "batch");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        double single = run(sizes[s], 0, &corrupted);
+        double batch = run(sizes[s], 1, &corrupted);
+        printf("\t%10zu %15.1f ns %15.1f ns\n", sizes[s], single, batch);
+    }
+    printf("\nCorrupted messages: %zu\n\n", corrupted);
+    return 0;
+}
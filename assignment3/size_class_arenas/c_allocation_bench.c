@@ -0,0 +1,327 @@
+/**
+ * READ ME
+ * This is a comparative benchmark for smalloc / sfree against other allocators
+ * - The same source is built once per allocator (see run_commands.sh):
+ *     default           -> the size-class arenas in this directory
+ *     -DBENCH_SINGLE_HEAP -> the single-heap best-fit allocator in ../stress_test_version_2
+ *     -DBENCH_SYSTEM      -> the system (glibc) malloc / free
+ * - Workloads (each one runs in its own forked child, so peak RSS is per workload):
+ *     uniform   the stress-test pattern: LIVE blocks of up to 32 KB, round-robin replacement,
+ *               plus a random free every D_FREQ requests to create holes
+ *     small     small-object churn: SMALL_LIVE blocks of 8..256 bytes replaced at random
+ *     growing   GROW_BUFFERS buffers that grow by doubling (allocate, copy, free) up to GROW_MAX
+ *     prodcons  one producer thread allocates, one consumer thread frees (skipped for the
+ *               single-heap allocator, which is not thread-safe)
+ * - Every smalloc and sfree is timed with clock_gettime; reports ops/s, p50 / p99 / p999 latency
+ *   of both calls, peak RSS growth over the workload, peak live bytes, the fragmentation marker
+ *   (1 - L/F) at the end of the run (allocator_stats; not available for glibc) and failed
+ *   allocations.
+ * - Output is CSV (default) or JSON lines with "json" as the first argument, so runs can be
+ *   appended to one file and compared.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#if defined(BENCH_SYSTEM)
+#define BENCH_NAME     "glibc"
+#define bench_alloc    malloc
+#define bench_free     free
+#elif defined(BENCH_SINGLE_HEAP)
+#include "../stress_test_version_2/allocator.h"   // smalloc, sfree, allocator_stats
+#define BENCH_NAME     "single_heap"
+#define BENCH_NO_THREADS
+#define bench_alloc    smalloc
+#define bench_free     sfree
+#else
+#include "allocator.h"   // smalloc, sfree, allocator_stats, tcache_flush_all
+#define BENCH_NAME     "size_class_arenas"
+#define bench_alloc    smalloc
+#define bench_free     sfree
+#endif
+
+// Tunable Parameters
+#define N_REQUESTS    200000        // allocation requests per workload
+#define MAX_REQ_SIZE  32 * 1024     // uniform: cap on a single request size (bytes)
+#define D_FREQ        128           // uniform: every D_FREQ requests, free a random live block
+#define LIVE          512           // uniform: concurrently live allocations
+#define SMALL_LIVE    4096          // small: concurrently live allocations
+#define SMALL_REQ_MAX 256           // small: cap on a request size (bytes)
+#define GROW_BUFFERS  16            // growing: buffers growing side by side
+#define GROW_MAX      64 * 1024     // growing: a buffer starts over once it reaches this size
+#define RING_SIZE     256           // prodcons: in-flight blocks (power of two)
+
+typedef struct {
+    const char *workload;
+    uint32_t *alloc_ns, *free_ns;   // one latency sample per call
+    size_t n_alloc, n_free;
+    size_t failures;
+    size_t live, live_max;          // requested bytes currently live / at the peak
+    double elapsed;                 // seconds for the whole workload
+} run_t;
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// timed wrappers: every call records one latency sample
+static void *timed_alloc(run_t *r, size_t sz) {
+    uint64_t t0 = now_ns();
+    void *p = bench_alloc(sz);
+    r->alloc_ns[r->n_alloc++] = (uint32_t)(now_ns() - t0);
+    if (p == NULL) { r->failures++; return NULL; }
+    *(volatile char*)p = 1;       // touch the block like a real user would
+    r->live += sz;
+    if (r->live > r->live_max) r->live_max = r->live;
+    return p;
+}
+
+static void timed_free(run_t *r, void *p, size_t sz) {
+    uint64_t t0 = now_ns();
+    bench_free(p);
+    r->free_ns[r->n_free++] = (uint32_t)(now_ns() - t0);
+    r->live -= sz;
+}
+
+// uniform: the c_allocation_stress_test.c request pattern
+static void run_uniform(run_t *r) {
+    void *pool[LIVE] = {0};
+    size_t sizes[LIVE] = {0};
+    size_t idx = 0;
+
+    for (size_t i = 0; i < N_REQUESTS; ++i) {
+        size_t sz = (size_t)(rand() % MAX_REQ_SIZE) + 1;
+        void *p = timed_alloc(r, sz);
+        if (p) {
+            if (pool[idx]) timed_free(r, pool[idx], sizes[idx]);
+            pool[idx] = p;
+            sizes[idx] = sz;
+            idx = (idx + 1) % LIVE;
+        }
+        if ((i + 1) % D_FREQ == 0) {
+            size_t k = (size_t)(rand() % LIVE);
+            if (pool[k]) { timed_free(r, pool[k], sizes[k]); pool[k] = NULL; }
+        }
+    }
+    for (size_t k = 0; k < LIVE; ++k) if (pool[k]) timed_free(r, pool[k], sizes[k]);
+}
+
+// small: random replacement of many small objects
+static void run_small(run_t *r) {
+    static void *pool[SMALL_LIVE];
+    static size_t sizes[SMALL_LIVE];
+
+    for (size_t i = 0; i < N_REQUESTS; ++i) {
+        size_t k = (size_t)(rand() % SMALL_LIVE);
+        if (pool[k]) { timed_free(r, pool[k], sizes[k]); pool[k] = NULL; }
+        size_t sz = (size_t)(rand() % (SMALL_REQ_MAX - 7)) + 8;
+        pool[k] = timed_alloc(r, sz);
+        sizes[k] = sz;
+    }
+    for (size_t k = 0; k < SMALL_LIVE; ++k) if (pool[k]) timed_free(r, pool[k], sizes[k]);
+}
+
+// growing: buffers doubling in size, the way a vector or string builder grows
+static void run_growing(run_t *r) {
+    void *buf[GROW_BUFFERS] = {0};
+    size_t cap[GROW_BUFFERS] = {0};
+
+    for (size_t i = 0; i < N_REQUESTS; ++i) {
+        size_t b = (size_t)(rand() % GROW_BUFFERS);
+        size_t next = (cap[b] == 0 || cap[b] >= GROW_MAX) ? 16 : cap[b] * 2;
+        void *p = timed_alloc(r, next);
+        if (p == NULL) continue;
+        if (buf[b]) {
+            if (next > cap[b]) memcpy(p, buf[b], cap[b]);
+            timed_free(r, buf[b], cap[b]);
+        }
+        buf[b] = p;
+        cap[b] = next;
+    }
+    for (size_t b = 0; b < GROW_BUFFERS; ++b) if (buf[b]) timed_free(r, buf[b], cap[b]);
+}
+
+#ifndef BENCH_NO_THREADS
+// prodcons: every block is freed by a different thread than the one that allocated it
+typedef struct {
+    void *slots[RING_SIZE];
+    size_t sizes[RING_SIZE];        // producer side only: size last pushed into each slot
+    _Atomic size_t head, tail;
+    _Atomic int done;
+    run_t *r;
+} ring_t;
+
+static void *consumer(void *arg) {
+    ring_t *q = (ring_t*)arg;
+    for (;;) {
+        size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+        if (head == atomic_load_explicit(&q->tail, memory_order_acquire)) {
+            if (atomic_load(&q->done)) break;
+            sched_yield();
+            continue;
+        }
+        uint64_t t0 = now_ns();
+        bench_free(q->slots[head % RING_SIZE]);
+        q->r->free_ns[q->r->n_free++] = (uint32_t)(now_ns() - t0);
+        atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    }
+    return NULL;
+}
+
+static void run_prodcons(run_t *r) {
+    static ring_t q;
+    q.r = r;
+    pthread_t t;
+    pthread_create(&t, NULL, consumer, &q);
+
+    for (size_t i = 0; i < N_REQUESTS; ++i) {
+        size_t sz = (rand() % 8 != 0) ? (size_t)(rand() % 1024) + 1 : (size_t)(rand() % MAX_REQ_SIZE) + 1;
+        uint64_t t0 = now_ns();
+        void *p = bench_alloc(sz);
+        r->alloc_ns[r->n_alloc++] = (uint32_t)(now_ns() - t0);
+        if (p == NULL) { r->failures++; continue; }
+        *(volatile char*)p = 1;
+
+        size_t tail = atomic_load_explicit(&q.tail, memory_order_relaxed);
+        while (tail - atomic_load_explicit(&q.head, memory_order_acquire) == RING_SIZE) sched_yield();
+        q.slots[tail % RING_SIZE] = p;
+        r->live += sz - q.sizes[tail % RING_SIZE];     // the previous block in this slot is freed
+        q.sizes[tail % RING_SIZE] = sz;
+        if (r->live > r->live_max) r->live_max = r->live;
+        atomic_store_explicit(&q.tail, tail + 1, memory_order_release);
+    }
+    atomic_store(&q.done, 1);
+    pthread_join(t, NULL);
+}
+#endif
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+// q-th quantile of n samples (sorts them in place)
+static uint32_t percentile(uint32_t *v, size_t n, double q) {
+    if (n == 0) return 0;
+    qsort(v, n, sizeof(uint32_t), cmp_u32);
+    size_t i = (size_t)(q * (double)(n - 1));
+    return v[i];
+}
+
+// VmHWM / VmRSS from /proc/self/status, in KB
+static long proc_status_kb(const char *key) {
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f == NULL) return -1;
+    char line[256];
+    long kb = -1;
+    size_t len = strlen(key);
+    while (fgets(line, sizeof line, f)) {
+        if (strncmp(line, key, len) == 0) { kb = atol(line + len); break; }
+    }
+    fclose(f);
+    return kb;
+}
+
+// reset the peak RSS to the current RSS (Linux >= 4.0); returns 0 if it is not supported
+static int reset_peak_rss(void) {
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (f == NULL) return 0;
+    int ok = fputs("5", f) >= 0;
+    return (fclose(f) == 0) && ok;
+}
+
+// Run one workload in this (child) process and print its result line
+static void run_workload(const char *name, void (*fn)(run_t*), int json) {
+    run_t r = { .workload = name };
+    size_t max_calls = 2 * N_REQUESTS + SMALL_LIVE + LIVE;
+    r.alloc_ns = calloc(max_calls, sizeof(uint32_t));   // sample buffers come from the system allocator
+    r.free_ns  = calloc(max_calls, sizeof(uint32_t));
+    memset(r.alloc_ns, 0, max_calls * sizeof(uint32_t));   // fault the pages in before measuring RSS
+    memset(r.free_ns, 0, max_calls * sizeof(uint32_t));
+
+    srand(1);
+    int reset = reset_peak_rss();
+    long rss_base = reset ? proc_status_kb("VmRSS:") : 0;
+
+    uint64_t t0 = now_ns();
+    fn(&r);
+    r.elapsed = (double)(now_ns() - t0) * 1e-9;
+
+    long peak_kb = proc_status_kb("VmHWM:") - rss_base;
+
+    double frag = -1.0;   // -1: not available
+#ifndef BENCH_SYSTEM
+#ifndef BENCH_SINGLE_HEAP
+    tcache_flush_all();   // cached blocks are free memory too
+#endif
+    size_t N = 0, F = 0, L = 0;
+    allocator_stats(&N, &F, &L);
+    frag = (F > 0) ? 1.0 - (double)L / (double)F : 0.0;
+#endif
+
+    double ops_per_sec = (double)(r.n_alloc + r.n_free) / r.elapsed;
+    uint32_t a50 = percentile(r.alloc_ns, r.n_alloc, 0.50), a99 = percentile(r.alloc_ns, r.n_alloc, 0.99),
+             a999 = percentile(r.alloc_ns, r.n_alloc, 0.999);
+    uint32_t f50 = percentile(r.free_ns, r.n_free, 0.50), f99 = percentile(r.free_ns, r.n_free, 0.99),
+             f999 = percentile(r.free_ns, r.n_free, 0.999);
+
+    if (json) {
+        printf("{\"allocator\":\"%s\",\"workload\":\"%s\",\"ops\":%zu,\"ops_per_sec\":%.0f,"
+               "\"alloc_p50_ns\":%u,\"alloc_p99_ns\":%u,\"alloc_p999_ns\":%u,"
+               "\"free_p50_ns\":%u,\"free_p99_ns\":%u,\"free_p999_ns\":%u,"
+               "\"peak_rss_kb\":%ld,\"peak_live_kb\":%zu,\"frag\":%.4f,\"failures\":%zu}\n",
+               BENCH_NAME, name, r.n_alloc + r.n_free, ops_per_sec, a50, a99, a999, f50, f99, f999,
+               peak_kb, r.live_max / 1024, frag, r.failures);
+    } else {
+        printf("%s,%s,%zu,%.0f,%u,%u,%u,%u,%u,%u,%ld,%zu,%.4f,%zu\n",
+               BENCH_NAME, name, r.n_alloc + r.n_free, ops_per_sec, a50, a99, a999, f50, f99, f999,
+               peak_kb, r.live_max / 1024, frag, r.failures);
+    }
+    fflush(stdout);
+    free(r.alloc_ns);
+    free(r.free_ns);
+}
+
+int main(int argc, char **argv) {
+    int json = (argc > 1 && strcmp(argv[1], "json") == 0);
+
+    struct { const char *name; void (*fn)(run_t*); } workloads[] = {
+        { "uniform",  run_uniform },
+        { "small",    run_small },
+        { "growing",  run_growing },
+#ifndef BENCH_NO_THREADS
+        { "prodcons", run_prodcons },
+#endif
+    };
+
+    if (!json) {
+        printf("allocator,workload,ops,ops_per_sec,alloc_p50_ns,alloc_p99_ns,alloc_p999_ns,"
+               "free_p50_ns,free_p99_ns,free_p999_ns,peak_rss_kb,peak_live_kb,frag,failures\n");
+        fflush(stdout);
+    }
+
+    for (size_t w = 0; w < sizeof workloads / sizeof workloads[0]; ++w) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            run_workload(workloads[w].name, workloads[w].fn, json);
+            _exit(0);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            fprintf(stderr, "%s: workload %s did not finish\n", BENCH_NAME, workloads[w].name);
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+/**
+ * READ ME
+ * This is a two-thread ping-pong benchmark for cross-thread smalloc / sfree
+ * - Two threads exchange N_MESSAGES messages each way through two lock-free single-producer rings.
+ * - Every message is allocated with smalloc by the sender and released with sfree by the receiver,
+ *   so every single free is a cross-thread free of a block the other thread allocated.
+ * - Message sizes are random up to MAX_MSG_SIZE: the small ones go through the per-thread caches,
+ *   the rest are freed into the shared arenas, through the lock-free remote-free stack whenever
+ *   the other thread is holding the arena lock.
+ * - Reports messages per second (each message = one smalloc + one sfree) and failed allocations.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "allocator.h"   // smalloc, sfree
+
+// Tunable Parameters
+#define N_MESSAGES    500000      // messages sent by each thread
+#define MAX_MSG_SIZE  4096        // cap on a single message size (bytes)
+#define RING_SIZE     256         // in-flight messages per direction (power of two)
+
+typedef struct {
+    void *slots[RING_SIZE];
+    _Atomic size_t head;      // next slot to read  (consumer)
+    _Atomic size_t tail;      // next slot to write (producer)
+} ring_t;
+
+typedef struct side {
+    ring_t *out, *in;
+    struct side *peer;
+    unsigned seed;
+    size_t failures;
+    _Atomic int done;         // set once this side has sent all its messages
+} side_t;
+
+static int ring_push(ring_t *r, void *p) {
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&r->head, memory_order_acquire) == RING_SIZE) return 0;
+    r->slots[tail % RING_SIZE] = p;
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+static void *ring_pop(ring_t *r) {
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&r->tail, memory_order_acquire)) return NULL;
+    void *p = r->slots[head % RING_SIZE];
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    return p;
+}
+
+static inline double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Receive (and free) one message if there is one
+static int receive_one(side_t *s) {
+    void *msg = ring_pop(s->in);
+    if (msg == NULL) return 0;
+    sfree(msg);
+    return 1;
+}
+
+static void *side(void *arg) {
+    side_t *s = (side_t*)arg;
+
+    for (size_t sent = 0; sent < N_MESSAGES; ++sent) {
+        size_t sz = (size_t)(rand_r(&s->seed) % MAX_MSG_SIZE) + 1;
+        void *msg = smalloc(sz);
+        if (msg == NULL) { s->failures++; continue; }
+        memset(msg, 0xAB, sz < 64 ? sz : 64);
+
+        while (!ring_push(s->out, msg)) {
+            if (!receive_one(s)) sched_yield();   // keep draining so neither side stalls
+        }
+        receive_one(s);
+    }
+    atomic_store(&s->done, 1);
+
+    // drain until the peer has finished sending and its ring is empty
+    while (!atomic_load(&s->peer->done) || atomic_load(&s->in->head) != atomic_load(&s->in->tail)) {
+        if (!receive_one(s)) sched_yield();
+    }
+    return NULL;
+}
+
+int main(void) {
+    static ring_t a_to_b, b_to_a;
+    static side_t a, b;
+    a.out = &a_to_b; a.in = &b_to_a; a.peer = &b; a.seed = 1;
+    b.out = &b_to_a; b.in = &a_to_b; b.peer = &a; b.seed = 2;
+    pthread_t ta, tb;
+
+    init_arenas();
+
+    double start = now_sec();
+    pthread_create(&ta, NULL, side, &a);
+    pthread_create(&tb, NULL, side, &b);
+    pthread_join(ta, NULL);
+    pthread_join(tb, NULL);
+    double elapsed = now_sec() - start;
+
+    size_t N = 0, F = 0, L = 0;
+    allocator_stats(&N, &F, &L);
+
+    printf("\nPing-Pong (2 threads, cross-thread sfree): \n");
+    printf("\tMessages: %zu\n", (size_t)(2 * N_MESSAGES));
+    printf("\tTime: %.3f s\n", elapsed);
+    printf("\tThroughput: %.2f M messages/s\n", 2.0 * N_MESSAGES / elapsed / 1e6);
+    printf("\tFailed Allocations: %zu\n", a.failures + b.failures);
+    printf("\tFree Memory After Run: %.2f MB in %zu blocks\n", F / (1024.0 * 1024.0), N);
+    printf("\n");
+    return 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * READ ME
+ * This is a benchmark of STL containers on the size-class arenas (smalloc_resource.hpp)
+ * against the default allocator
+ * - vector:        ROUNDS times, VECTORS vectors each grown by push_back to a random length
+ *                  (up to VECTOR_LEN ints), then all destroyed.
+ * - unordered_map: ROUNDS times, MAP_KEYS random keys inserted, every other one erased, the
+ *                  rest looked up, then the map destroyed.
+ * - list:          ROUNDS times, LIST_LEN ints pushed, every other one erased, then destroyed.
+ * - Each workload runs on std::allocator, smalloc_allocator<T>, std::pmr containers on
+ *   smalloc_resource, and std::pmr containers on an arena_monotonic_resource released after
+ *   every round.
+ * - Reports milliseconds per round, and whether every allocator computed the same checksum.
+ */
+
+
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <memory_resource>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include "smalloc_resource.hpp"   // smalloc_allocator, smalloc_resource, arena_monotonic_resource
+
+// Tunable Parameters
+#define ROUNDS      10
+#define VECTORS     20000       // vectors per round
+#define VECTOR_LEN  512         // ints per vector (at most)
+#define MAP_KEYS    200000      // keys inserted per round
+#define LIST_LEN    500000      // ints per list
+
+template <class A, class T>
+using rebind_t = typename std::allocator_traits<A>::template rebind_alloc<T>;
+
+static double now_ms() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+template <class A>
+static uint64_t vector_round(const A &a, std::mt19937 &rng) {
+    std::vector<std::vector<int, rebind_t<A, int>>> vectors;
+    vectors.reserve(VECTORS);
+    uint64_t sum = 0;
+    for (int v = 0; v < VECTORS; ++v) {
+        vectors.emplace_back(rebind_t<A, int>(a));
+        int len = (int)(rng() % VECTOR_LEN) + 1;
+        for (int i = 0; i < len; ++i) vectors.back().push_back(i);
+        sum += vectors.back().size();
+    }
+    return sum;
+}
+
+template <class A>
+static uint64_t map_round(const A &a, std::mt19937 &rng) {
+    using pair_t = std::pair<const uint32_t, uint32_t>;
+    std::unordered_map<uint32_t, uint32_t, std::hash<uint32_t>, std::equal_to<uint32_t>, rebind_t<A, pair_t>>
+        map(16, std::hash<uint32_t>(), std::equal_to<uint32_t>(), rebind_t<A, pair_t>(a));
+    std::vector<uint32_t> keys(MAP_KEYS);
+    for (auto &k : keys) { k = rng(); map[k] = k ^ 0x5bd1e995u; }
+    for (size_t i = 0; i < keys.size(); i += 2) map.erase(keys[i]);
+    uint64_t sum = 0;
+    for (size_t i = 1; i < keys.size(); i += 2) {
+        auto it = map.find(keys[i]);
+        if (it != map.end()) sum += it->second;
+    }
+    return sum + map.size();
+}
+
+template <class A>
+static uint64_t list_round(const A &a, std::mt19937 &) {
+    std::list<int, rebind_t<A, int>> list{rebind_t<A, int>(a)};
+    for (int i = 0; i < LIST_LEN; ++i) list.push_back(i);
+    bool drop = true;
+    for (auto it = list.begin(); it != list.end(); drop = !drop) it = drop ? list.erase(it) : std::next(it);
+    uint64_t sum = 0;
+    for (int x : list) sum += (uint64_t)x;
+    return sum;
+}
+
+// ms per round of one workload on one allocator; after_round runs outside the container's life
+template <class A, class Round, class After>
+static double run(const A &a, Round round, After after_round, uint64_t *checksum) {
+    std::mt19937 rng(42);
+    *checksum = 0;
+    double start = now_ms();
+    for (int r = 0; r < ROUNDS; ++r) {
+        *checksum += round(a, rng);
+        after_round();
+    }
+    return (now_ms() - start) / ROUNDS;
+}
+
+int main() {
+    const char *workloads[3] = { "vector", "unordered_map", "list" };
+    const char *names[4] = { "std::allocator", "smalloc_allocator", "pmr smalloc_resource", "pmr arena_monotonic" };
+    double ms[3][4];
+    uint64_t sums[3][4];
+    bool same = true;
+
+    arena_monotonic_resource monotonic;
+    std::pmr::polymorphic_allocator<std::byte> on_smalloc(smalloc_default_resource());
+    std::pmr::polymorphic_allocator<std::byte> on_monotonic(&monotonic);
+    auto nothing = [] {};
+    auto release = [&monotonic] { monotonic.release(); };
+
+    for (int w = 0; w < 3; ++w) {
+        auto go = [&](auto &&a, int k, auto after) {
+            using A = std::decay_t<decltype(a)>;
+            if (w == 0) ms[w][k] = run(a, vector_round<A>, after, &sums[w][k]);
+            else if (w == 1) ms[w][k] = run(a, map_round<A>, after, &sums[w][k]);
+            else ms[w][k] = run(a, list_round<A>, after, &sums[w][k]);
+        };
+        go(std::allocator<std::byte>(), 0, nothing);
+        go(smalloc_allocator<std::byte>(), 1, nothing);
+        go(on_smalloc, 2, nothing);
+        go(on_monotonic, 3, release);
+        for (int k = 1; k < 4; ++k) same = same && sums[w][k] == sums[w][0];
+    }
+
+    printf("\nSTL containers, ms per round (%d rounds): \n", ROUNDS);
+    printf("\t%-22s %12s %14s %12s\n", "", workloads[0], workloads[1], workloads[2]);
+    for (int k = 0; k < 4; ++k) printf("\t%-22s %12.2f %14.2f %12.2f\n", names[k], ms[0][k], ms[1][k], ms[2][k]);
+    printf("\nSame results on every allocator: %s\n\n", same ? "yes" : "NO");
+    return same ? 0 : 1;
+}
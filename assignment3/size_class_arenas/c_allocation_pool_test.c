@@ -0,0 +1,122 @@
+/**
+ * READ ME
+ * This is a benchmark of the fixed-size object pools (pool.h) against smalloc / sfree
+ * - All allocations are one struct type (struct node, 48 bytes), the case pools are made for.
+ * - Each thread keeps LIVE nodes and makes OPS_PER_THREAD requests: every request frees the node
+ *   in a random slot and allocates a new one there, writing and later checking a tag in it.
+ * - Three allocators: smalloc / sfree, a pool without magazines (one lock per call) and a typed
+ *   pool with per-thread magazines (POOL_DEFINE), each on 1 and THREADS threads.
+ * - Reports wall-clock ns per operation of each thread (one op = one alloc or free) and
+ *   corrupted nodes (should be 0).
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "allocator.h"   // smalloc, sfree
+#include "pool.h"        // pool_create, pool_alloc, pool_free, POOL_DEFINE
+
+// Tunable Parameters
+#define OPS_PER_THREAD  1000000     // allocation requests per thread
+#define LIVE            1024        // live nodes kept by each thread
+#define THREADS         4
+
+struct node {
+    struct node *left, *right;
+    uint64_t key;
+    uint64_t tag;                   // written on alloc, checked on free
+    double value[2];
+};
+
+POOL_DEFINE(node, struct node, POOL_MAGAZINES)
+
+enum { USE_SMALLOC, USE_POOL_LOCKED, USE_POOL_MAGAZINES };
+
+typedef struct {
+    int kind;
+    unsigned seed;
+    size_t corrupted;
+} worker_t;
+
+static pool_t *locked_pool;
+
+static inline double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static struct node *node_new(int kind) {
+    if (kind == USE_SMALLOC) return smalloc(sizeof(struct node));
+    if (kind == USE_POOL_LOCKED) return pool_alloc(locked_pool);
+    return node_alloc();
+}
+
+static void node_delete(int kind, struct node *n) {
+    if (kind == USE_SMALLOC) sfree(n);
+    else if (kind == USE_POOL_LOCKED) pool_free(locked_pool, n);
+    else node_free(n);
+}
+
+static void *worker(void *arg) {
+    worker_t *w = (worker_t*)arg;
+    struct node *live[LIVE] = {0};
+
+    for (size_t i = 0; i < OPS_PER_THREAD; ++i) {
+        size_t k = (size_t)(rand_r(&w->seed) % LIVE);
+        if (live[k]) {
+            if (live[k]->tag != (uint64_t)(uintptr_t)&live[k]) w->corrupted++;
+            node_delete(w->kind, live[k]);
+        }
+        live[k] = node_new(w->kind);
+        if (live[k]) live[k]->tag = (uint64_t)(uintptr_t)&live[k];
+    }
+    for (size_t k = 0; k < LIVE; ++k) if (live[k]) node_delete(w->kind, live[k]);
+    return NULL;
+}
+
+// wall-clock ns per op of each thread, one allocator on t threads (flat = perfect scaling)
+static double run(int kind, int t, size_t *corrupted) {
+    pthread_t threads[THREADS];
+    worker_t workers[THREADS];
+
+    double start = now_sec();
+    for (int i = 0; i < t; ++i) {
+        workers[i] = (worker_t){ .kind = kind, .seed = (unsigned)(i + 1), .corrupted = 0 };
+        pthread_create(&threads[i], NULL, worker, &workers[i]);
+    }
+    for (int i = 0; i < t; ++i) pthread_join(threads[i], NULL);
+    double elapsed = now_sec() - start;
+
+    for (int i = 0; i < t; ++i) *corrupted += workers[i].corrupted;
+    return elapsed * 1e9 / (2.0 * OPS_PER_THREAD);
+}
+
+int main(void) {
+    const char *names[3] = { "smalloc / sfree", "pool (locked)", "pool (magazines)" };
+    size_t corrupted = 0;
+
+    locked_pool = pool_create(sizeof(struct node), _Alignof(struct node));
+    pool_prefill(locked_pool, LIVE * THREADS);
+
+    printf("\nFixed-size pool vs smalloc (%zu-byte objects, %d live per thread): \n",
+           pool_object_size(node_pool()), LIVE);
+    printf("\t%-18s %14s %11d threads\n", "", "1 thread", THREADS);
+    for (int kind = 0; kind < 3; ++kind) {
+        double one = run(kind, 1, &corrupted);
+        double many = run(kind, THREADS, &corrupted);
+        printf("\t%-18s %11.1f ns %11.1f ns\n", names[kind], one, many);
+    }
+
+    size_t in_use = 0, mapped = 0;
+    pool_stats(node_pool(), &in_use, &mapped);
+    printf("\nMagazine pool after the run: %zu objects out (held in magazines), %.2f MB mapped\n",
+           in_use, mapped / (1024.0 * 1024.0));
+    printf("Corrupted nodes: %zu\n\n", corrupted);
+
+    pool_destroy(locked_pool);
+    return 0;
+}
@@ -0,0 +1,151 @@
+/**
+ * READ ME
+ * This is a test of the sampling heap profiler (prof.h): how close its estimate of the live heap
+ * per call site comes to the truth, and what it costs
+ * - Four call sites build a heap of known shape while a fifth churns without keeping anything:
+ *     site_small   N_SMALL objects of SMALL_SIZE bytes (slab sizes), kept
+ *     site_medium  N_MEDIUM objects of MEDIUM_SIZE bytes (arena sizes), every other one freed
+ *     site_huge    N_HUGE objects of HUGE_SIZE bytes (own mappings), kept
+ *     site_grow    N_GROW buffers grown by srealloc to GROW_SIZE bytes, kept
+ *     site_churn   CHURN objects of MEDIUM_SIZE bytes, each freed right away
+ * - Profiles with a mean of SAMPLE_MEAN bytes, dumps the folded stacks (prof.folded) and the
+ *   pprof profile (prof.heap), and reads the folded file back to sum the estimate per site.
+ * - Reports true and estimated live bytes per site, and ns per smalloc / sfree pair of a hot
+ *   loop without the profiler, with it on, and after it was stopped.
+ * - Build with -rdynamic so the dump can name the sites.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "allocator.h"   // smalloc, sfree, srealloc
+#include "prof.h"        // allocator_prof_start, allocator_prof_dump
+
+// Tunable Parameters
+#define SAMPLE_MEAN  (64 * 1024)   // bytes between samples
+#define N_SMALL      200000
+#define SMALL_SIZE   48
+#define N_MEDIUM     20000
+#define MEDIUM_SIZE  2000
+#define N_HUGE       40
+#define HUGE_SIZE    (300 * 1024)
+#define N_GROW       2000
+#define GROW_SIZE    8192
+#define CHURN        200000
+#define HOT_OPS      20000000      // smalloc / sfree pairs per timed loop
+
+static const char *sites[5] = { "site_small", "site_medium", "site_huge", "site_grow", "site_churn" };
+static size_t truth[5];
+
+static void *small_objs[N_SMALL], *medium_objs[N_MEDIUM], *huge_objs[N_HUGE], *grow_objs[N_GROW];
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+__attribute__((noinline)) void site_small(void) {
+    for (int i = 0; i < N_SMALL; i++) small_objs[i] = smalloc(SMALL_SIZE);
+    truth[0] = (size_t)N_SMALL * SMALL_SIZE;
+}
+
+__attribute__((noinline)) void site_medium(void) {
+    for (int i = 0; i < N_MEDIUM; i++) medium_objs[i] = smalloc(MEDIUM_SIZE);
+    for (int i = 0; i < N_MEDIUM; i += 2) { sfree(medium_objs[i]); medium_objs[i] = NULL; }
+    truth[1] = (size_t)(N_MEDIUM / 2) * MEDIUM_SIZE;
+}
+
+__attribute__((noinline)) void site_huge(void) {
+    for (int i = 0; i < N_HUGE; i++) huge_objs[i] = smalloc(HUGE_SIZE);
+    truth[2] = (size_t)N_HUGE * HUGE_SIZE;
+}
+
+__attribute__((noinline)) void site_grow(void) {
+    for (int i = 0; i < N_GROW; i++) {
+        void *p = NULL;
+        for (size_t n = 64; n <= GROW_SIZE; n *= 2) p = srealloc(p, n);
+        grow_objs[i] = p;
+    }
+    truth[3] = (size_t)N_GROW * GROW_SIZE;
+}
+
+__attribute__((noinline)) void site_churn(void) {
+    for (int i = 0; i < CHURN; i++) {
+        volatile char *p = smalloc(MEDIUM_SIZE);
+        p[0] = 1;
+        sfree((void*)p);
+    }
+    truth[4] = 0;
+}
+
+// ns per smalloc / sfree pair of a hot loop
+static double hot_loop(void) {
+    uint64_t start = now_ns();
+    for (int i = 0; i < HOT_OPS; i++) {
+        void *volatile p = smalloc(64);
+        sfree(p);
+    }
+    return (double)(now_ns() - start) / HOT_OPS;
+}
+
+// estimated live bytes per site from the folded dump: a stack counts for the innermost site on it
+static int read_folded(const char *path, double est[5]) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return -1;
+    static char line[1 << 16];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char *space = strrchr(line, ' ');
+        if (space == NULL) continue;
+        double bytes = strtod(space + 1, NULL);
+        int site = -1;
+        char *best = NULL;
+        for (int s = 0; s < 5; s++) {
+            char *at = strstr(line, sites[s]);
+            if (at != NULL && at > best) { best = at; site = s; }
+        }
+        if (site >= 0) est[site] += bytes;
+    }
+    fclose(f);
+    return 0;
+}
+
+int main(void) {
+    double off = hot_loop();
+
+    if (allocator_prof_start(SAMPLE_MEAN) != 0) { printf("could not start the profiler\n"); return 1; }
+    double on = hot_loop();
+    site_small();
+    site_medium();
+    site_huge();
+    site_grow();
+    site_churn();
+
+    double est[5] = { 0 };
+    if (allocator_prof_dump("prof.folded", PROF_FOLDED) != 0 || allocator_prof_dump("prof.heap", PROF_PPROF) != 0 ||
+        read_folded("prof.folded", est) != 0) {
+        printf("could not write the profile\n");
+        return 1;
+    }
+    allocator_prof_stop();
+    double stopped = hot_loop();
+
+    printf("\nLive heap per call site, sampled every %d bytes on average: \n", SAMPLE_MEAN);
+    printf("\t%-12s %14s %14s %8s\n", "site", "true bytes", "estimated", "error");
+    for (int s = 0; s < 5; s++) {
+        double err = truth[s] ? 100.0 * (est[s] - (double)truth[s]) / (double)truth[s] : 0;
+        printf("\t%-12s %14zu %14.0f %7.1f%%\n", sites[s], truth[s], est[s], err);
+    }
+    printf("\nsmalloc / sfree of 64 bytes: %.2f ns without the profiler, %.2f ns profiling, %.2f ns stopped\n",
+           off, on, stopped);
+    printf("Profiles written to prof.folded (flamegraph.pl) and prof.heap (pprof)\n\n");
+
+    for (int i = 0; i < N_SMALL; i++) sfree(small_objs[i]);
+    for (int i = 0; i < N_MEDIUM; i++) sfree(medium_objs[i]);
+    for (int i = 0; i < N_HUGE; i++) sfree(huge_objs[i]);
+    for (int i = 0; i < N_GROW; i++) sfree(grow_objs[i]);
+    return 0;
+}
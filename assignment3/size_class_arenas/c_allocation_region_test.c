@@ -0,0 +1,111 @@
+/**
+ * READ ME
+ * This is a benchmark of the region (bump) allocator (region.h) against smalloc / sfree
+ * for request-scoped memory
+ * - Simulates N_REQUESTS requests; each allocates a random number (up to MAX_OBJS) of scratch
+ *   objects of random sizes (up to MAX_OBJ_SIZE, one in BIG_FREQ of BIG_OBJ_SIZE), fills them,
+ *   and drops all of them when the request ends.
+ * - smalloc: one sfree per object at the end of the request.
+ *   region:  one region_reset per request; halfway through, a mark is taken, and the objects
+ *            allocated after it are dropped with region_reset_to_mark (a nested scope), then
+ *            the objects before the mark are checked to be intact.
+ * - Reports ns per request for both, the memory the region held at its peak, and corrupted
+ *   objects (should be 0).
+ * - Then requests near SIZE_MAX (which would wrap when rounded to the region's alignment) must
+ *   come back NULL; reports how many were served anyway (should be 0).
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "allocator.h"   // smalloc, sfree
+#include "region.h"      // region_create, region_alloc, region_mark, region_reset_to_mark
+
+// Tunable Parameters
+#define N_REQUESTS    20000     // requests simulated
+#define MAX_OBJS      512       // scratch objects per request (at most)
+#define MAX_OBJ_SIZE  256       // bytes per object (at most)
+#define BIG_FREQ      64        // one in BIG_FREQ objects is a big one
+#define BIG_OBJ_SIZE  (16 * 1024)
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline size_t obj_size(unsigned *seed) {
+    if (rand_r(seed) % BIG_FREQ == 0) return BIG_OBJ_SIZE;
+    return (size_t)(rand_r(seed) % MAX_OBJ_SIZE) + 1;
+}
+
+int main(void) {
+    static void *objs[MAX_OBJS];
+    static size_t sizes[MAX_OBJS];
+    size_t corrupted = 0;
+
+    // smalloc / sfree: every object freed on its own
+    unsigned seed = 1;
+    uint64_t start = now_ns();
+    for (int r = 0; r < N_REQUESTS; ++r) {
+        int n = rand_r(&seed) % MAX_OBJS + 1;
+        for (int i = 0; i < n; ++i) {
+            sizes[i] = obj_size(&seed);
+            objs[i] = smalloc(sizes[i]);
+            if (objs[i]) memset(objs[i], (unsigned char)i, sizes[i]);
+        }
+        for (int i = 0; i < n; ++i) sfree(objs[i]);
+    }
+    double per_req_malloc = (double)(now_ns() - start) / N_REQUESTS;
+
+    // region: one reset per request, with a nested scope dropped at a mark halfway
+    region_t *region = region_create(0);
+    size_t reserved_max = 0;
+    seed = 1;
+    start = now_ns();
+    for (int r = 0; r < N_REQUESTS; ++r) {
+        int n = rand_r(&seed) % MAX_OBJS + 1;
+        int half = n / 2;
+        region_mark_t mark = region_mark(region);
+        for (int i = 0; i < n; ++i) {
+            if (i == half) mark = region_mark(region);
+            sizes[i] = obj_size(&seed);
+            objs[i] = region_alloc(region, sizes[i]);
+            if (objs[i]) memset(objs[i], (unsigned char)i, sizes[i]);
+        }
+        size_t reserved = 0;
+        region_stats(region, NULL, &reserved);
+        if (reserved > reserved_max) reserved_max = reserved;
+
+        region_reset_to_mark(region, mark);
+        for (int i = 0; i < half; ++i) {
+            unsigned char *p = objs[i];
+            if (p && (p[0] != (unsigned char)i || p[sizes[i] - 1] != (unsigned char)i)) corrupted++;
+        }
+        region_reset(region);
+    }
+    double per_req_region = (double)(now_ns() - start) / N_REQUESTS;
+
+    // requests that wrap when rounded up: NULL, and the region is left as it was
+    size_t oversized = 0;
+    for (size_t n = SIZE_MAX - 15; n != 0; n++) {
+        if (region_alloc(region, n) != NULL) oversized++;
+        if (region_alloc_aligned(region, 64, n) != NULL) oversized++;
+    }
+
+    size_t used = 0, reserved = 0;
+    region_stats(region, &used, &reserved);
+    region_destroy(region);
+
+    printf("\nRequest-scoped scratch memory (%d requests, up to %d objects each): \n", N_REQUESTS, MAX_OBJS);
+    printf("\tsmalloc / sfree per object:   %10.1f ns per request\n", per_req_malloc);
+    printf("\tregion_alloc + region_reset:  %10.1f ns per request\n", per_req_region);
+    printf("\nRegion: %.2f KB held at the peak, %.2f KB after the last reset (%zu bytes in use)\n",
+           reserved_max / 1024.0, reserved / 1024.0, used);
+    printf("Corrupted objects: %zu\n", corrupted);
+    printf("Oversized requests served: %zu\n\n", oversized);
+    return oversized != 0;
+}
@@ -0,0 +1,203 @@
+/**
+ * READ ME
+ * This is a replay driver for allocation traces recorded with trace.h
+ * (e.g. SMALLOC_TRACE=app.trace LD_PRELOAD=./libsmalloc.so ./some_program)
+ * - Usage: ./replay <trace file> [first|best|tlsf] [nomerge]
+ * - Replays every event of the trace, in file order, on one thread against this build of the
+ *   allocator, so the same trace can be fed through different fit strategies, merging, and
+ *   arena boundaries and sizes (SMALLOC_CONF, see allocator.h; the command-line strategy and
+ *   nomerge options win over it). The replay is deterministic.
+ * - Recorded addresses are mapped to the replayed blocks with a hash table; frees of addresses
+ *   the trace never allocated (allocated before tracing started) are skipped and counted.
+ * - Reports replay time and ns/op, failed allocations, peak and final mapped memory, external
+ *   fragmentation (1 - L/F) at the end, and the request-size distribution over the size
+ *   classes and power-of-two buckets, the input for picking SMALL_MAX / MED_MAX.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "allocator.h"   // smalloc, sfree, srealloc, scalloc, saligned_alloc, allocator_stats
+#include "trace.h"       // trace_record_t
+
+#define MAPPED_SAMPLE 1024     // sample the mapped size every MAPPED_SAMPLE events
+
+// open-addressing map: recorded address -> replayed pointer
+typedef struct {
+    uint64_t key;              // 0 = empty slot, 1 = deleted slot
+    void *ptr;
+} slot_t;
+
+static slot_t *table = NULL;
+static size_t table_cap = 0, table_used = 0;   // used counts deleted slots too
+
+static inline size_t hash_ptr(uint64_t key) {
+    return (size_t)((key >> 4) * 0x9E3779B97F4A7C15ull);
+}
+
+static void map_put(uint64_t key, void *ptr);
+
+static void map_grow(void) {
+    slot_t *old = table;
+    size_t old_cap = table_cap;
+    table_cap = old_cap ? old_cap * 2 : 1024;
+    table = calloc(table_cap, sizeof(slot_t));
+    table_used = 0;
+    for (size_t i = 0; i < old_cap; ++i) if (old[i].key > 1) map_put(old[i].key, old[i].ptr);
+    free(old);
+}
+
+static void map_put(uint64_t key, void *ptr) {
+    if (2 * (table_used + 1) > table_cap) map_grow();
+    size_t i = hash_ptr(key) & (table_cap - 1);
+    while (table[i].key > 1) i = (i + 1) & (table_cap - 1);
+    if (table[i].key == 0) table_used++;
+    table[i].key = key;
+    table[i].ptr = ptr;
+}
+
+// remove key and return its replayed pointer (NULL if it is not live)
+static void *map_take(uint64_t key) {
+    if (table_cap == 0) return NULL;
+    size_t i = hash_ptr(key) & (table_cap - 1);
+    while (table[i].key != 0) {
+        if (table[i].key == key) {
+            table[i].key = 1;
+            return table[i].ptr;
+        }
+        i = (i + 1) & (table_cap - 1);
+    }
+    return NULL;
+}
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <trace file> [first|best|tlsf] [nomerge]\n", argv[0]);
+        return 1;
+    }
+    init_arenas();   // applies SMALLOC_CONF first
+    for (int a = 2; a < argc; ++a) {
+        if (strcmp(argv[a], "first") == 0) FIT_STRATEGY = FIRST_FIT;
+        else if (strcmp(argv[a], "best") == 0) FIT_STRATEGY = BEST_FIT;
+        else if (strcmp(argv[a], "tlsf") == 0) FIT_STRATEGY = TLSF_FIT;
+        else if (strcmp(argv[a], "nomerge") == 0) MERGE_ENABLED = 0;
+    }
+
+    // load the whole trace (the driver's own memory comes from the system allocator)
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL) { perror(argv[1]); return 1; }
+    char magic[8];
+    if (fread(magic, 1, 8, f) != 8 || memcmp(magic, TRACE_MAGIC, 8) != 0) {
+        fprintf(stderr, "%s: not an allocation trace\n", argv[1]);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    size_t n_events = (size_t)(ftell(f) - 8) / sizeof(trace_record_t);
+    fseek(f, 8, SEEK_SET);
+    trace_record_t *ev = malloc(n_events * sizeof(trace_record_t));
+    n_events = fread(ev, sizeof(trace_record_t), n_events, f);
+    fclose(f);
+
+    size_t allocs = 0, frees = 0, reallocs = 0, failures = 0, unknown_frees = 0;
+    size_t tier[5] = {0};                   // slab, small, med, large, huge
+    size_t buckets[33] = {0};               // requests by power of two
+    size_t mapped_max = 0;
+    unsigned threads = 0;
+
+    allocator_config_t cfg;
+    allocator_get_config(&cfg);
+    uint64_t start = now_ns();
+
+    for (size_t i = 0; i < n_events; ++i) {
+        trace_record_t *e = &ev[i];
+        if (e->thread > threads) threads = e->thread;
+
+        if (e->op == TRACE_FREE) {
+            void *p = map_take(e->ptr);
+            if (p) { sfree(p); frees++; }
+            else unknown_frees++;
+            continue;
+        }
+
+        void *p = NULL;
+        uint64_t key = e->ptr;
+        if (e->op == TRACE_REALLOC_FROM && i + 1 < n_events) {
+            trace_record_t *to = &ev[++i];
+            void *old = map_take(e->ptr);
+            p = srealloc(old, to->size ? to->size : 1);
+            reallocs++;
+            key = to->ptr ? to->ptr : e->ptr;  // failed in the traced process: old one stays live
+            if (p == NULL) { if (old) map_put(e->ptr, old); failures++; }
+            e = to;
+        } else if (e->op == TRACE_MALLOC || e->op == TRACE_CALLOC || e->op == TRACE_ALIGNED) {
+            if (e->op == TRACE_MALLOC) p = smalloc(e->size);
+            else if (e->op == TRACE_CALLOC) p = scalloc(1, e->size);
+            else p = saligned_alloc((size_t)1 << e->arg, e->size);
+            allocs++;
+            if (p == NULL) failures++;
+        } else {
+            continue;
+        }
+
+        size_t sz = e->size;
+        tier[sz <= SLAB_MAX ? 0 : sz <= cfg.small_max ? 1 : sz <= cfg.med_max ? 2 : sz < cfg.mmap_threshold ? 3 : 4]++;
+        buckets[sz ? 64 - __builtin_clzll((unsigned long long)sz) - 1 : 0]++;
+
+        if (p != NULL) {
+            if (key == 0) { sfree(p); continue; }      // failed in the traced process: drop it
+            void *stale = map_take(key);   // threads raced between a free and its record
+            if (stale) sfree(stale);
+            map_put(key, p);
+        }
+        if (i % MAPPED_SAMPLE == 0 && allocator_mapped_size() > mapped_max) mapped_max = allocator_mapped_size();
+    }
+    double elapsed = (double)(now_ns() - start) * 1e-9;
+
+    tcache_flush_all();
+    size_t N = 0, F = 0, L = 0;
+    allocator_stats(&N, &F, &L);
+    size_t mapped = allocator_mapped_size();
+    if (mapped > mapped_max) mapped_max = mapped;
+
+    const char *fit = FIT_STRATEGY == FIRST_FIT ? "first fit" : FIT_STRATEGY == TLSF_FIT ? "tlsf" : "best fit";
+    printf("\nReplay of %s (%s, merge %s, %d arenas, small_max %zu, med_max %zu): \n", argv[1], fit,
+           MERGE_ENABLED ? "on" : "off", cfg.arenas, cfg.small_max, cfg.med_max);
+    printf("\tEvents: %zu (%u threads, %.3f s recorded)\n", n_events, threads,
+           n_events ? ev[n_events - 1].ts_ns * 1e-9 : 0.0);
+    printf("\tAllocations: %zu, Reallocations: %zu, Frees: %zu\n", allocs, reallocs, frees);
+    printf("\tFailed Allocations: %zu\n", failures);
+    printf("\tSkipped Frees (allocated before tracing): %zu\n", unknown_frees);
+    printf("\tTime: %.3f s (%.1f ns/op)\n", elapsed,
+           (allocs + reallocs + frees) ? elapsed * 1e9 / (double)(allocs + reallocs + frees) : 0.0);
+
+    printf("\nMemory: \n");
+    printf("\tMapped: %.2f MB final, %.2f MB maximum\n", mapped / (1024.0 * 1024.0), mapped_max / (1024.0 * 1024.0));
+    printf("\tExternal Fragmentation (1 - L/F): %.4f (%zu free blocks)\n", F ? 1.0 - (double)L / (double)F : 0.0, N);
+
+    size_t req = allocs + reallocs;
+    printf("\nRequest Sizes by Class: \n");
+    const char *names[5] = { "slab  (<= SLAB_MAX)", "small (<= small_max)", "med   (<= med_max)",
+                             "large", "huge  (>= mmap_threshold)" };
+    for (int t = 0; t < 5; ++t)
+        printf("\t%-26s %10zu  %6.2f%%\n", names[t], tier[t], req ? 100.0 * tier[t] / req : 0.0);
+
+    printf("\nRequest Sizes by Power of Two: \n");
+    for (int b = 0; b < 33; ++b) {
+        if (buckets[b] == 0) continue;
+        printf("\t[%10zu, %10zu)  %10zu  %6.2f%%\n", (size_t)1 << b, (size_t)2 << b, buckets[b],
+               100.0 * buckets[b] / req);
+    }
+    printf("\n");
+    free(ev);
+    free(table);
+    return 0;
+}
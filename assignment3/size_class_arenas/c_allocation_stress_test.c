@@ -9,6 +9,9 @@
  * - Tracks an external fragmentation marker: (1 − L/F) (L = largest free block, F = total free memory)
  * - Reports utilization (fraction of heap used) and turnover (total memory allocated as multiples of heap size) at the point of first failure 
  *   to show efficiency under stress.
+ * - Arenas grow by mapping extra chunks instead of failing, so also reports the peak memory mapped.
+ * - Reports resident memory at the end of the run, before and after allocator_purge().
+ * - Reports the average latency of smalloc and sfree (ns/op), timed around the calls only (allocator_stats is excluded).
  * 
  * - NOTE: In the allocator module, please provide the function: void allocator_stats(size* N, size* F, size* L) 
      which computes: N: number of free blocks, F: amount of free memory (in bytes), L: size of the largest free block (in bytes). 
@@ -19,6 +22,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <stdint.h>
 #include "allocator.h"   // smalloc, sfree, allocator_stats
 
 // Tunable Parameters (keep these value to test all version first)
@@ -30,6 +34,13 @@
 // Random request size in [1..MAX_REQ_SIZE]
 static inline size_t rand_size() { return (size_t)(rand() % MAX_REQ_SIZE) + 1; }
 
+// Monotonic clock in nanoseconds (used to time smalloc / sfree calls)
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
 int main(void) {
     srand(time(0)); // seed the rng
   
@@ -37,6 +48,7 @@ int main(void) {
     size_t before_first_failure = N_REQUESTS;    // stays N_REQUESTS if no failure occurs
     double ext_frag_max = 0.0;                   // running max of (1 - L/F)
     size_t freelist_len_max = 0;                 // running max of free-list length
+    size_t mapped_max = 0;                       // running max of memory mapped by the arenas
     size_t total_requested = 0;                  // total bytes requested across all attempts
     size_t total_allocated = 0;                  // total bytes allocated (successful requests only)
     size_t requested_before_first_failure = 0;   // bytes requested strictly before the first failure
@@ -48,6 +60,10 @@ int main(void) {
     size_t fail_nodes = 0, fail_F = 0, fail_L = 0;
     size_t fail_req_size = 0;
 
+    uint64_t malloc_ns = 0, free_ns = 0;         // total time spent inside smalloc / sfree
+    size_t malloc_calls = 0, free_calls = 0;
+    uint64_t t0;
+
     // Keep up to LIVE live allocations at any time
     void *pool[LIVE];
     for (size_t k = 0; k < LIVE; ++k) pool[k] = NULL;
@@ -60,14 +76,22 @@ int main(void) {
         total_requested += sz;
         if (!failure_seen) requested_before_first_failure += sz;
 
+        t0 = now_ns();
         void *p = smalloc(sz);
+        malloc_ns += now_ns() - t0;
+        malloc_calls++;
 
         if (p) {
             success++;
             total_allocated += sz;
 
             // Keep up to LIVE active allocations: overwrite round-robin slot
-            if (pool[idx]) sfree(pool[idx]);   // drop the old one in this slot
+            if (pool[idx]) {                    // drop the old one in this slot
+                t0 = now_ns();
+                sfree(pool[idx]);
+                free_ns += now_ns() - t0;
+                free_calls++;
+            }
             pool[idx] = p;
             idx = (idx + 1) % LIVE;
         } else if (before_first_failure == N_REQUESTS) {
@@ -86,7 +110,13 @@ int main(void) {
         // Every D_FREQ requests, free a random live slot to create holes
         if ((i + 1) % D_FREQ == 0) {
             size_t k = (size_t)(rand() % LIVE);
-            if (pool[k]) { sfree(pool[k]); pool[k] = NULL; }
+            if (pool[k]) {
+                t0 = now_ns();
+                sfree(pool[k]);
+                free_ns += now_ns() - t0;
+                free_calls++;
+                pool[k] = NULL;
+            }
         }
 
         // Update running maxes: external fragmentation and free-list length
@@ -95,6 +125,7 @@ int main(void) {
        
 
         if (nodes > freelist_len_max) freelist_len_max = nodes;
+        if (allocator_mapped_size() > mapped_max) mapped_max = allocator_mapped_size();
 
         double ext_frag = (F > 0) ? (1.0 - (double)L / (double)F) : 0.0;
         if (ext_frag > ext_frag_max) ext_frag_max = ext_frag;
@@ -142,6 +173,18 @@ int main(void) {
         printf("\tBytes-to-Failure Turnover (BTF): %.2f x MEM_SIZE\n", bytes_to_fail_turnover);
     }
     
+    printf("\nMapped Memory: \n");
+    printf("\tFinal: %.2f MB\n", allocator_mapped_size() / (1024.0 * 1024.0));
+    printf("\tMaximum: %.2f MB\n", mapped_max / (1024.0 * 1024.0));
+
+    size_t mapped = 0, resident = 0;
+    allocator_mem_stats(&mapped, &resident);
+    printf("\tResident: %.2f MB\n", resident / (1024.0 * 1024.0));
+    size_t purged = allocator_purge();
+    allocator_mem_stats(&mapped, &resident);
+    printf("\tResident after purge: %.2f MB (%.2f MB purged)\n",
+           resident / (1024.0 * 1024.0), purged / (1024.0 * 1024.0));
+
     printf("\nFreelist Length: \n");
     printf("\tFinal: %zu\n", final_nodes);
     printf("\tMaximum: %zu\n", freelist_len_max);
@@ -150,6 +193,12 @@ int main(void) {
     printf("\tFinal: %.4f\n", final_ext_frag);
     printf("\tMaximum: %.4f\n", ext_frag_max);
 
+    printf("\nLatency: \n");
+    printf("\tsmalloc: %.1f ns/op (%zu calls)\n",
+           malloc_calls ? (double)malloc_ns / (double)malloc_calls : 0.0, malloc_calls);
+    printf("\tsfree:   %.1f ns/op (%zu calls)\n",
+           free_calls ? (double)free_ns / (double)free_calls : 0.0, free_calls);
+
     printf("\n");
 
     return 0;
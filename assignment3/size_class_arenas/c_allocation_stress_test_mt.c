@@ -0,0 +1,106 @@
+/**
+ * READ ME
+ * This is the multi-threaded variant of c_allocation_stress_test.c for smalloc and sfree
+ * - Runs the same churn pattern on 1, 2, ... MAX_THREADS threads (default: number of online CPUs,
+ *   or pass the maximum thread count as the first argument).
+ * - Each thread makes OPS_PER_THREAD requests, keeping LIVE_PER_THREAD live blocks in its own pool:
+ *   every request frees whatever occupied a random slot and allocates a new block there.
+ * - Request sizes are mostly small (7 in 8 are up to 1 KB, served by the per-thread caches);
+ *   the rest are up to MAX_REQ_SIZE and go to the shared, locked arenas.
+ * - Reports total throughput (Mops/s, one op = one smalloc or sfree) and speedup over one thread,
+ *   to show how the allocator scales when the threads no longer share one global lock.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "allocator.h"   // smalloc, sfree, tcache_flush_all
+
+// Tunable Parameters
+#define OPS_PER_THREAD   200000        // allocation requests per thread
+#define LIVE_PER_THREAD  64            // live allocations kept by each thread
+#define SMALL_REQ_SIZE   1024          // cap on a small request (bytes)
+#define MAX_REQ_SIZE     32 * 1024     // cap on an occasional big request (bytes)
+#define MAX_THREADS      64
+
+typedef struct {
+    unsigned seed;
+    size_t ops;         // smalloc + sfree calls made
+    size_t failures;    // smalloc calls that returned NULL
+} worker_t;
+
+// Random request size: mostly small, sometimes up to MAX_REQ_SIZE
+static inline size_t rand_size(unsigned *seed) {
+    if (rand_r(seed) % 8 != 0) return (size_t)(rand_r(seed) % SMALL_REQ_SIZE) + 1;
+    return (size_t)(rand_r(seed) % MAX_REQ_SIZE) + 1;
+}
+
+static inline double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void *worker(void *arg) {
+    worker_t *w = (worker_t*)arg;
+    void *pool[LIVE_PER_THREAD] = {0};
+
+    for (size_t i = 0; i < OPS_PER_THREAD; ++i) {
+        size_t k = (size_t)(rand_r(&w->seed) % LIVE_PER_THREAD);
+        if (pool[k]) { sfree(pool[k]); w->ops++; }
+
+        pool[k] = smalloc(rand_size(&w->seed));
+        w->ops++;
+        if (pool[k] == NULL) w->failures++;
+        else *(volatile char*)pool[k] = 1;   // touch the block like a real user would
+    }
+
+    for (size_t k = 0; k < LIVE_PER_THREAD; ++k) {
+        if (pool[k]) { sfree(pool[k]); w->ops++; }
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    long max_threads = (argc > 1) ? atol(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_threads < 1) max_threads = 1;
+    if (max_threads > MAX_THREADS) max_threads = MAX_THREADS;
+
+    pthread_t threads[MAX_THREADS];
+    worker_t workers[MAX_THREADS];
+    double base_rate = 0.0;
+
+    init_arenas();
+
+    printf("\nThreads | Ops        | Time (s) | Mops/s   | Speedup | Failures\n");
+    printf("--------+------------+----------+----------+---------+---------\n");
+
+    for (long t = 1; t <= max_threads; ++t) {
+        for (long i = 0; i < t; ++i) {
+            workers[i].seed = (unsigned)(time(0) + i);
+            workers[i].ops = 0;
+            workers[i].failures = 0;
+        }
+
+        double start = now_sec();
+        for (long i = 0; i < t; ++i) pthread_create(&threads[i], NULL, worker, &workers[i]);
+        for (long i = 0; i < t; ++i) pthread_join(threads[i], NULL);
+        double elapsed = now_sec() - start;
+
+        size_t ops = 0, failures = 0;
+        for (long i = 0; i < t; ++i) { ops += workers[i].ops; failures += workers[i].failures; }
+
+        double rate = (double)ops / elapsed / 1e6;
+        if (t == 1) base_rate = rate;
+
+        printf("%7ld | %10zu | %8.3f | %8.2f | %6.2fx | %zu\n",
+               t, ops, elapsed, rate, rate / base_rate, failures);
+    }
+
+    printf("\n");
+    return 0;
+}
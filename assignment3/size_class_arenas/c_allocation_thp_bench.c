@@ -0,0 +1,184 @@
+/**
+ * READ ME
+ * This is a benchmark of transparent huge page backing for the arena chunks (config option thp)
+ * - The stress workload, scaled up to a large working set: random sizes up to MAX_REQ_SIZE are
+ *   allocated until WORKING_SET bytes are live, then ACCESSES random objects are read and
+ *   written, and every D_FREQ accesses a random object is freed and replaced (holes, reuse).
+ * - Runs once with thp:0 and once with thp:1, each in a fresh child process so that every chunk
+ *   is mapped under the setting being measured.
+ * - Counts dTLB load and store misses with perf_event_open (user space only) around the access
+ *   phase; where the CPU exposes no such counters (e.g. most VMs) they read n/a. Page faults
+ *   (a software counter, always available) show the huge pages too: one fault per 2 MB.
+ * - Reports ms for the build and access phases, the counters, and the AnonHugePages of the
+ *   process (from /proc/self/smaps_rollup) at the end of the run.
+ */
+
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "allocator.h"   // smalloc, sfree, allocator_get_config, allocator_config
+
+// Tunable Parameters
+#define WORKING_SET   (512ul * 1024 * 1024)   // live bytes during the access phase
+#define MAX_REQ_SIZE  (32 * 1024)             // as in the stress test
+#define ACCESSES      20000000                // random object accesses
+#define D_FREQ        128                     // every D_FREQ accesses an object is replaced
+#define MAX_OBJS      (WORKING_SET / 64)
+
+#define N_COUNTERS    3
+static const char *counter_names[N_COUNTERS] = { "dTLB-load-misses", "dTLB-store-misses", "page-faults" };
+
+typedef struct result {
+    double build_ms, access_ms;
+    long long counts[N_COUNTERS];     // -1 = counter not available
+    size_t anon_huge_kb;
+} result_t;
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t xorshift(uint64_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static int counter_open(int which) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    if (which == 2) {
+        attr.type = PERF_TYPE_SOFTWARE;
+        attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+    } else {
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) |
+                      ((which == 0 ? PERF_COUNT_HW_CACHE_OP_READ : PERF_COUNT_HW_CACHE_OP_WRITE) << 8);
+    }
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static size_t anon_huge_kb(void) {
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    if (f == NULL) return 0;
+    char line[256];
+    size_t kb = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "AnonHugePages: %zu kB", &kb) == 1) break;
+    }
+    fclose(f);
+    return kb;
+}
+
+// the whole workload in the calling process, under the given thp setting
+static void run(int thp, result_t *r) {
+    allocator_config_t cfg;
+    allocator_get_config(&cfg);
+    cfg.thp = thp;
+    allocator_config(&cfg);
+
+    static void *objs[MAX_OBJS];
+    static uint32_t sizes[MAX_OBJS];
+    uint64_t seed = 88172645463325252ull;
+    size_t n = 0, live = 0;
+
+    uint64_t start = now_ns();
+    while (live < WORKING_SET && n < MAX_OBJS) {
+        size_t s = (size_t)(xorshift(&seed) % MAX_REQ_SIZE) + 1;
+        objs[n] = smalloc(s);
+        if (objs[n] == NULL) break;
+        memset(objs[n], (int)n, s);
+        sizes[n++] = (uint32_t)s;
+        live += s;
+    }
+    r->build_ms = (double)(now_ns() - start) / 1e6;
+
+    int fds[N_COUNTERS];
+    for (int c = 0; c < N_COUNTERS; c++) {
+        fds[c] = counter_open(c);
+        if (fds[c] >= 0) ioctl(fds[c], PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    uint64_t sum = 0;
+    start = now_ns();
+    for (long i = 0; i < ACCESSES; i++) {
+        size_t k = (size_t)(xorshift(&seed) % n);
+        uint8_t *p = objs[k];
+        size_t off = (size_t)(xorshift(&seed) % sizes[k]);
+        sum += p[off];
+        p[off] = (uint8_t)sum;
+        if (i % D_FREQ == 0) {
+            sfree(objs[k]);
+            size_t s = (size_t)(xorshift(&seed) % MAX_REQ_SIZE) + 1;
+            objs[k] = smalloc(s);
+            if (objs[k] == NULL) { s = 1; objs[k] = smalloc(1); }
+            ((uint8_t*)objs[k])[s - 1] = 1;
+            sizes[k] = (uint32_t)s;
+        }
+    }
+    r->access_ms = (double)(now_ns() - start) / 1e6;
+
+    for (int c = 0; c < N_COUNTERS; c++) {
+        r->counts[c] = -1;
+        if (fds[c] < 0) continue;
+        ioctl(fds[c], PERF_EVENT_IOC_DISABLE, 0);
+        long long v;
+        if (read(fds[c], &v, sizeof(v)) == sizeof(v)) r->counts[c] = v;
+        close(fds[c]);
+    }
+    r->anon_huge_kb = anon_huge_kb();
+    if (sum == 42) printf(" ");     // keep the accesses
+}
+
+int main(void) {
+    result_t results[2];
+    for (int thp = 0; thp < 2; thp++) {
+        int pipefd[2];
+        if (pipe(pipefd) != 0) return 1;
+        pid_t pid = fork();
+        if (pid == 0) {
+            result_t r;
+            run(thp, &r);
+            ssize_t w = write(pipefd[1], &r, sizeof(r));
+            _exit(w == sizeof(r) ? 0 : 1);
+        }
+        close(pipefd[1]);
+        ssize_t got = read(pipefd[0], &results[thp], sizeof(results[thp]));
+        close(pipefd[0]);
+        waitpid(pid, NULL, 0);
+        if (got != sizeof(results[thp])) { printf("run with thp:%d failed\n", thp); return 1; }
+    }
+
+    printf("\nStress workload over a %lu MB working set, %d random accesses: \n", WORKING_SET >> 20, ACCESSES);
+    printf("\t%-22s %16s %16s\n", "", "thp:0", "thp:1");
+    printf("\t%-22s %16.1f %16.1f\n", "build (ms)", results[0].build_ms, results[1].build_ms);
+    printf("\t%-22s %16.1f %16.1f\n", "access (ms)", results[0].access_ms, results[1].access_ms);
+    for (int c = 0; c < N_COUNTERS; c++) {
+        printf("\t%-22s", counter_names[c]);
+        for (int thp = 0; thp < 2; thp++) {
+            if (results[thp].counts[c] < 0) printf(" %16s", "n/a");
+            else printf(" %16lld", results[thp].counts[c]);
+        }
+        printf("\n");
+    }
+    printf("\t%-22s %16zu %16zu\n", "AnonHugePages (MB)", results[0].anon_huge_kb >> 10, results[1].anon_huge_kb >> 10);
+    printf("\n");
+    return 0;
+}
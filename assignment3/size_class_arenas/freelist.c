@@ -1,16 +1,341 @@
 #include "freelist.h"
 #include <stddef.h>
+#include <string.h>
 
-// three independent freelist heads
-common_header_t *freelist_small = NULL;
-common_header_t *freelist_med   = NULL;
-common_header_t *freelist_large = NULL;
+// three independent arenas
+arena_t arena_small = { .lock = PTHREAD_MUTEX_INITIALIZER };
+arena_t arena_med   = { .lock = PTHREAD_MUTEX_INITIALIZER };
+arena_t arena_large = { .lock = PTHREAD_MUTEX_INITIALIZER };
 
-// initialize any freelist head for a memory region 
-void init_free_list_explicit(common_header_t **head, void *mem, size_t mem_size) {
-    if (head == NULL || mem == NULL || mem_size <= sizeof(common_header_t)) return; // need these definitions to run
-    *head = (common_header_t*)mem;
-    (*head)->size = (int)(mem_size - sizeof(common_header_t));
-    (*head)->next = NULL;
+_Static_assert(sizeof(free_links_t) + sizeof(free_tree_t) + sizeof(int) <= TREE_MIN,
+               "a free block of TREE_MIN bytes must hold its tree node");
+_Static_assert(sizeof(common_header_t) == 8 && CHUNK_HDR % BLOCK_ALIGN == BLOCK_ALIGN - sizeof(common_header_t),
+               "payloads must start on a BLOCK_ALIGN boundary");
+
+// add a memory region to an arena: one free block followed by an in-use fence header,
+// so every block has a valid physical successor
+void init_free_list_explicit(arena_t *arena, void *mem, size_t mem_size) {
+    if (arena == NULL || mem == NULL || mem_size < 2 * sizeof(common_header_t) + MIN_PAYLOAD) return; // need these definitions to run
+    common_header_t *fence = (common_header_t*)((uint8_t*)mem + mem_size - sizeof(common_header_t));
+    fence->size = 0;
+    fence->flags = BLOCK_IN_USE;
+    fence->tag = 0;
+
+    common_header_t *block = (common_header_t*)mem;
+    block->size = (int)(mem_size - 2 * sizeof(common_header_t));
+    block->flags = 0;
+    block->tag = 0;
+    block_set_free(block);
+    bin_insert(arena, block);
+}
+
+// link a chunk at the front of a chunk list
+void chunk_list_push(chunk_t **head, chunk_t *chunk) {
+    chunk->prev = NULL;
+    chunk->next = *head;
+    if (*head) (*head)->prev = chunk;
+    *head = chunk;
+}
+
+// unlink a chunk from its list
+void chunk_list_remove(chunk_t **head, chunk_t *chunk) {
+    if (chunk->prev) chunk->prev->next = chunk->next;
+    else *head = chunk->next;
+    if (chunk->next) chunk->next->prev = chunk->prev;
+}
+
+// mark a block free: write its footer and tell the next block
+void block_set_free(common_header_t *block) {
+    block->flags &= ~BLOCK_IN_USE;
+    *FOOTER(block) = block->size;
+    NEXT_BLOCK(block)->flags |= BLOCK_PREV_FREE;
+}
+
+// mark a block allocated (its footer becomes payload; purged pages fault back in on use)
+void block_set_used(common_header_t *block) {
+    block->flags = (block->flags | BLOCK_IN_USE) & ~BLOCK_PURGED;
+    NEXT_BLOCK(block)->flags &= ~BLOCK_PREV_FREE;
+}
+
+// bin of a block size: fl = power-of-two range, sl = linear sub-range inside it
+void bin_mapping(size_t size, int *fl, int *sl) {
+    if (size < SL_COUNT) {
+        *fl = 0;
+        *sl = (int)size;
+        return;
+    }
+    int log2 = 31 - __builtin_clz((unsigned)size);
+    *fl = log2 - SL_LOG2 + 1;
+    *sl = (int)(size >> (log2 - SL_LOG2)) - SL_COUNT;
+}
+
+// first non-empty bin at or after (fl, sl) in size order; returns 0 if there is none
+int bin_find_from(arena_t *arena, int *fl, int *sl) {
+    if (*fl >= FL_COUNT) return 0;
+    uint32_t sl_bits = (*sl < SL_COUNT) ? arena->sl_map[*fl] & (~0u << *sl) : 0;
+    if (sl_bits == 0) {
+        uint32_t fl_bits = (*fl + 1 < 32) ? arena->fl_map & (~0u << (*fl + 1)) : 0;
+        if (fl_bits == 0) return 0;
+        *fl = __builtin_ctz(fl_bits);
+        sl_bits = arena->sl_map[*fl];
+    }
+    *sl = __builtin_ctz(sl_bits);
+    return 1;
+}
+
+// size-ordered red-black trees, one per bin (CLRS, NULL leaves): a bin's blocks span a range
+// of sizes, and its tree orders them by (size, address), so every key is distinct and equal
+// sizes are taken lowest address first. Small per-bin trees keep inserts shallow.
+#define T(h) FREE_TREE(h)
+
+static inline int tree_less(const common_header_t *a, const common_header_t *b) {
+    return a->size < b->size || (a->size == b->size && a < b);
+}
+
+static inline int tree_red(const common_header_t *h) {
+    return h != NULL && T(h)->red;
+}
+
+// put v where u hangs from its parent (or the root)
+static void tree_replace(common_header_t **root, common_header_t *u, common_header_t *v) {
+    common_header_t *p = T(u)->parent;
+    if (p == NULL) *root = v;
+    else if (T(p)->left == u) T(p)->left = v;
+    else T(p)->right = v;
+    if (v) T(v)->parent = p;
 }
 
+static void tree_rotate_left(common_header_t **root, common_header_t *x) {
+    common_header_t *y = T(x)->right;
+    T(x)->right = T(y)->left;
+    if (T(y)->left) T(T(y)->left)->parent = x;
+    tree_replace(root, x, y);
+    T(y)->left = x;
+    T(x)->parent = y;
+}
+
+static void tree_rotate_right(common_header_t **root, common_header_t *x) {
+    common_header_t *y = T(x)->left;
+    T(x)->left = T(y)->right;
+    if (T(y)->right) T(T(y)->right)->parent = x;
+    tree_replace(root, x, y);
+    T(y)->right = x;
+    T(x)->parent = y;
+}
+
+static void tree_insert(common_header_t **root, common_header_t *block) {
+    common_header_t *parent = NULL, **link = root;
+    while (*link) {
+        parent = *link;
+        link = tree_less(block, parent) ? &T(parent)->left : &T(parent)->right;
+    }
+    T(block)->left = T(block)->right = NULL;
+    T(block)->parent = parent;
+    T(block)->red = 1;
+    *link = block;
+
+    common_header_t *x = block, *p;
+    while ((p = T(x)->parent) != NULL && T(p)->red) {
+        common_header_t *g = T(p)->parent;     // exists: a red node is never the root
+        if (p == T(g)->left) {
+            common_header_t *u = T(g)->right;
+            if (tree_red(u)) {
+                T(p)->red = T(u)->red = 0;
+                T(g)->red = 1;
+                x = g;
+                continue;
+            }
+            if (x == T(p)->right) {
+                tree_rotate_left(root, p);
+                p = x;
+            }
+            T(p)->red = 0;
+            T(g)->red = 1;
+            tree_rotate_right(root, g);
+            break;
+        } else {
+            common_header_t *u = T(g)->left;
+            if (tree_red(u)) {
+                T(p)->red = T(u)->red = 0;
+                T(g)->red = 1;
+                x = g;
+                continue;
+            }
+            if (x == T(p)->left) {
+                tree_rotate_right(root, p);
+                p = x;
+            }
+            T(p)->red = 0;
+            T(g)->red = 1;
+            tree_rotate_left(root, g);
+            break;
+        }
+    }
+    T(*root)->red = 0;
+}
+
+static void tree_remove(common_header_t **root, common_header_t *z) {
+    common_header_t *x, *xp;        // the node moved up (maybe NULL) and its parent
+    int removed_red = T(z)->red;
+
+    if (T(z)->left == NULL || T(z)->right == NULL) {
+        x = T(z)->left ? T(z)->left : T(z)->right;
+        xp = T(z)->parent;
+        tree_replace(root, z, x);
+    } else {
+        common_header_t *y = T(z)->right;  // successor takes z's place and colour
+        while (T(y)->left) y = T(y)->left;
+        removed_red = T(y)->red;
+        x = T(y)->right;
+        if (T(y)->parent == z) {
+            xp = y;
+        } else {
+            xp = T(y)->parent;
+            tree_replace(root, y, x);
+            T(y)->right = T(z)->right;
+            T(T(y)->right)->parent = y;
+        }
+        tree_replace(root, z, y);
+        T(y)->left = T(z)->left;
+        T(T(y)->left)->parent = y;
+        T(y)->red = T(z)->red;
+    }
+    if (removed_red) return;
+
+    // x carries an extra black: push it up or resolve it with the sibling w
+    while (x != *root && !tree_red(x)) {
+        if (x == T(xp)->left) {
+            common_header_t *w = T(xp)->right;
+            if (T(w)->red) {
+                T(w)->red = 0;
+                T(xp)->red = 1;
+                tree_rotate_left(root, xp);
+                w = T(xp)->right;
+            }
+            if (!tree_red(T(w)->left) && !tree_red(T(w)->right)) {
+                T(w)->red = 1;
+                x = xp;
+                xp = T(x)->parent;
+            } else {
+                if (!tree_red(T(w)->right)) {
+                    T(T(w)->left)->red = 0;
+                    T(w)->red = 1;
+                    tree_rotate_right(root, w);
+                    w = T(xp)->right;
+                }
+                T(w)->red = T(xp)->red;
+                T(xp)->red = 0;
+                T(T(w)->right)->red = 0;
+                tree_rotate_left(root, xp);
+                x = *root;
+            }
+        } else {
+            common_header_t *w = T(xp)->left;
+            if (T(w)->red) {
+                T(w)->red = 0;
+                T(xp)->red = 1;
+                tree_rotate_right(root, xp);
+                w = T(xp)->left;
+            }
+            if (!tree_red(T(w)->left) && !tree_red(T(w)->right)) {
+                T(w)->red = 1;
+                x = xp;
+                xp = T(x)->parent;
+            } else {
+                if (!tree_red(T(w)->left)) {
+                    T(T(w)->right)->red = 0;
+                    T(w)->red = 1;
+                    tree_rotate_left(root, w);
+                    w = T(xp)->left;
+                }
+                T(w)->red = T(xp)->red;
+                T(xp)->red = 0;
+                T(T(w)->left)->red = 0;
+                tree_rotate_right(root, xp);
+                x = *root;
+            }
+        }
+    }
+    if (x) T(x)->red = 0;
+}
+
+// build the trees from the bins, or drop them (the bins stay as they are)
+void tree_index(arena_t *arena, int on) {
+    memset(arena->trees, 0, sizeof(arena->trees));
+    arena->indexed = on;
+    if (!on) return;
+    int fl0, sl0;
+    bin_mapping(TREE_MIN, &fl0, &sl0);
+    for (int fl = fl0; fl < FL_COUNT; fl++) {
+        for (int sl = 0; sl < SL_COUNT; sl++) {
+            for (common_header_t *c = arena->bins[fl][sl]; c; c = FREE_LINKS(c)->next) tree_insert(&arena->trees[fl][sl], c);
+        }
+    }
+}
+
+common_header_t *tree_lower_bound(arena_t *arena, size_t n) {
+    int fl, sl;
+    bin_mapping(n, &fl, &sl);
+    common_header_t *best = NULL;
+    for (common_header_t *c = arena->trees[fl][sl]; c != NULL; ) {
+        if ((size_t)c->size >= n) {
+            best = c;
+            c = T(c)->left;
+        } else {
+            c = T(c)->right;
+        }
+    }
+    if (best != NULL) return best;
+
+    /* every block of a larger bin fits: take the smallest of the first non-empty one */
+    sl++;
+    if (!bin_find_from(arena, &fl, &sl)) return NULL;
+    best = arena->trees[fl][sl];
+    while (T(best)->left) best = T(best)->left;
+    return best;
+}
+
+// push a free block on the front of its size bin (and into the tree of an indexed arena)
+void bin_insert(arena_t *arena, common_header_t *block) {
+    int fl, sl;
+    bin_mapping((size_t)block->size, &fl, &sl);
+    common_header_t *next = arena->bins[fl][sl];
+    FREE_LINKS(block)->prev = NULL;
+    FREE_LINKS(block)->next = next;
+    if (next) FREE_LINKS(next)->prev = block;
+    arena->bins[fl][sl] = block;
+    arena->fl_map |= (1u << fl);
+    arena->sl_map[fl] |= (1u << sl);
+    if (arena->indexed && block->size >= TREE_MIN) tree_insert(&arena->trees[fl][sl], block);
+    COUNTER_ADD(arena->free_bytes, (size_t)block->size);
+    COUNTER_ADD(arena->free_blocks, 1);
+}
+
+// unlink a free block from its size bin and tree (block->size must be unchanged since insert)
+void bin_remove(arena_t *arena, common_header_t *block) {
+    int fl, sl;
+    bin_mapping((size_t)block->size, &fl, &sl);
+    common_header_t *prev = FREE_LINKS(block)->prev, *next = FREE_LINKS(block)->next;
+    if (prev) FREE_LINKS(prev)->next = next;
+    else arena->bins[fl][sl] = next;
+    if (next) FREE_LINKS(next)->prev = prev;
+    if (arena->bins[fl][sl] == NULL) {
+        arena->sl_map[fl] &= ~(1u << sl);
+        if (arena->sl_map[fl] == 0) arena->fl_map &= ~(1u << fl);
+    }
+    if (arena->indexed && block->size >= TREE_MIN) tree_remove(&arena->trees[fl][sl], block);
+    COUNTER_SUB(arena->free_bytes, (size_t)block->size);
+    COUNTER_SUB(arena->free_blocks, 1);
+}
+
+// largest free block: it sits in the highest non-empty bin, so only that bin is scanned
+size_t bin_largest(arena_t *arena) {
+    if (arena->fl_map == 0) return 0;
+    int fl = 31 - __builtin_clz(arena->fl_map);
+    int sl = 31 - __builtin_clz(arena->sl_map[fl]);
+    size_t largest = 0;
+    for (common_header_t *c = arena->bins[fl][sl]; c; c = FREE_LINKS(c)->next) {
+        if ((size_t)c->size > largest) largest = (size_t)c->size;
+    }
+    return largest;
+}
@@ -2,17 +2,126 @@
 #define FREELIST_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
+// block header: 8 bytes, all an allocated block carries. Every block (header + payload) spans a
+// multiple of BLOCK_ALIGN and headers sit BLOCK_ALIGN - 8 past an aligned address, so every
+// payload is BLOCK_ALIGN-aligned and payload sizes are 8 mod BLOCK_ALIGN (see PAYLOAD_ROUND).
 typedef struct common_header {
-    int size;                    
-    struct common_header *next;     
+    int size;                       // payload bytes
+    uint16_t flags;                 // BLOCK_* bits (neighbours update BLOCK_PREV_FREE under the arena lock)
+    uint16_t tag;                   // written by the owner only: BLOCK_TAG_SAMPLED or 0
 } common_header_t;
 
-// three separate free list heads for each arena
-extern common_header_t *freelist_small;
-extern common_header_t *freelist_med;
-extern common_header_t *freelist_large;
+#define BLOCK_ALIGN 16
 
-void init_free_list_explicit(common_header_t **head, void *mem, size_t mem_size);
+#define BLOCK_IN_USE    0x1     // block is allocated
+#define BLOCK_PREV_FREE 0x2     // physically preceding block is free (its footer is valid)
+#define BLOCK_MMAPPED   0x4     // huge block living alone in its own mapping
+#define BLOCK_PURGED    0x8     // free block whose interior pages were handed back with madvise
+
+#define BLOCK_TAG_SAMPLED 0x5a3c    // allocated block tracked by the heap profiler (prof.h)
+
+// links stored in the payload of a FREE block (never touched while allocated). Blocks held by a
+// thread cache or queued for a remote free chain through next the same way.
+typedef struct free_links {
+    struct common_header *next;     // next free block in the same size bin
+    struct common_header *prev;     // previous free block in the same size bin
+} free_links_t;
+
+#define FREE_LINKS(h) ((free_links_t*)((uint8_t*)(h) + sizeof(common_header_t)))
+
+// node of the size-ordered red-black tree of a bin of an indexed arena (the large one), stored
+// in a free payload right after the free link. Only free blocks of at least TREE_MIN bytes (a
+// power of two, so a bin holds either none or only such blocks) are in the trees.
+typedef struct free_tree {
+    common_header_t *left, *right, *parent;
+    int red;
+} free_tree_t;
+
+#define FREE_TREE(h) ((free_tree_t*)((uint8_t*)FREE_LINKS(h) + sizeof(free_links_t)))
+#define TREE_MIN     64     // smallest payload indexed: holds the free link, the node and the footer
+
+// boundary tags: physical neighbours of a block
+#define NEXT_BLOCK(h) ((common_header_t*)((uint8_t*)(h) + sizeof(common_header_t) + (size_t)(h)->size))
+#define FOOTER(h)     ((int*)((uint8_t*)NEXT_BLOCK(h) - sizeof(int)))
+#define PREV_BLOCK(h) ((common_header_t*)((uint8_t*)(h) - sizeof(common_header_t) - (size_t)((int*)(h))[-1]))
+
+// chunk: one mapping of an arena. The header sits at the (CHUNK_ALIGN-aligned) start of the
+// mapping, followed by the blocks and an in-use fence header at the very end.
+typedef struct chunk {
+    struct chunk *next, *prev;      // chunk list of the same arena (or of the huge blocks)
+    struct arena *arena;            // owning arena (NULL for a huge block's own mapping)
+    size_t size;                    // mapped bytes
+    int thp;                        // advised MADV_HUGEPAGE: purge whole huge pages only
+} chunk_t;
+
+// the first header ends on a BLOCK_ALIGN boundary, so the first payload is aligned
+#define CHUNK_HDR            (((sizeof(chunk_t) + sizeof(common_header_t) + BLOCK_ALIGN - 1) & \
+                               ~(size_t)(BLOCK_ALIGN - 1)) - sizeof(common_header_t))
+#define CHUNK_FIRST_BLOCK(c) ((common_header_t*)((uint8_t*)(c) + CHUNK_HDR))
+
+// payload size of a block for a request of n bytes: header + payload a multiple of BLOCK_ALIGN
+#define PAYLOAD_ROUND(n) ((((size_t)(n) + sizeof(common_header_t) + BLOCK_ALIGN - 1) & \
+                           ~(size_t)(BLOCK_ALIGN - 1)) - sizeof(common_header_t))
+
+// every block payload must be able to hold the free links and footer once it is freed
+#define MIN_PAYLOAD ((int)PAYLOAD_ROUND(sizeof(free_links_t) + sizeof(int)))
+
+// two-level size bins (TLSF layout): the first level splits sizes by power of two,
+// the second level splits each power-of-two range into SL_COUNT equal sub-ranges
+#define SL_LOG2   4
+#define SL_COUNT  (1 << SL_LOG2)
+#define FL_COUNT  (32 - SL_LOG2 + 1)
+
+typedef struct arena {
+    pthread_mutex_t lock;                         // guards everything below but remote_free
+    _Atomic(common_header_t*) remote_free;        // lock-free MPSC stack of blocks freed while the lock was busy
+    chunk_t *chunks;                              // mapped chunks, newest first
+    _Atomic size_t chunk_size;                    // size of a regular chunk when the arena grows
+    _Atomic size_t mapped;                        // bytes mapped by this arena's chunks
+    _Atomic size_t free_bytes;                    // payload bytes of the blocks in the bins
+    _Atomic size_t free_blocks;                   // number of blocks in the bins
+    _Atomic size_t spilled_in;                    // requests of other arenas served from here
+    _Atomic size_t spilled_out;                   // requests of this arena served by a neighbour
+    common_header_t *bins[FL_COUNT][SL_COUNT];    // size-segregated, doubly linked freelists
+    uint32_t fl_map;                              // bit f set <=> some bins[f][*] is non-empty
+    uint32_t sl_map[FL_COUNT];                    // bit s set <=> bins[f][s] is non-empty
+    int indexed;                                  // free blocks >= TREE_MIN are also in trees (tree_index)
+    common_header_t *trees[FL_COUNT][SL_COUNT];   // per-bin roots, ordered by (size, address)
+} arena_t;
+
+// arena counters have one writer at a time (the lock holder), so they are bumped with a plain
+// load + store; being atomic only lets snapshots read them without taking the lock
+#define COUNTER_ADD(c, v) atomic_store_explicit(&(c), atomic_load_explicit(&(c), memory_order_relaxed) + (v), \
+                                                memory_order_relaxed)
+#define COUNTER_SUB(c, v) atomic_store_explicit(&(c), atomic_load_explicit(&(c), memory_order_relaxed) - (v), \
+                                                memory_order_relaxed)
+
+// three separate arenas, one per size class (the large one indexed by size)
+extern arena_t arena_small;
+extern arena_t arena_med;
+extern arena_t arena_large;
+
+void init_free_list_explicit(arena_t *arena, void *mem, size_t mem_size);
+
+void chunk_list_push(chunk_t **head, chunk_t *chunk);
+void chunk_list_remove(chunk_t **head, chunk_t *chunk);
+
+void block_set_free(common_header_t *block);
+void block_set_used(common_header_t *block);
+
+void bin_mapping(size_t size, int *fl, int *sl);
+int bin_find_from(arena_t *arena, int *fl, int *sl);
+void bin_insert(arena_t *arena, common_header_t *block);
+void bin_remove(arena_t *arena, common_header_t *block);
+size_t bin_largest(arena_t *arena);
+
+// exact best fit of an indexed arena in O(log N): the smallest free block of at least n bytes
+// (n >= TREE_MIN), the lowest address among equal sizes; NULL if none fits
+void tree_index(arena_t *arena, int on);    // build the trees from the bins (1), or drop them (0)
+common_header_t *tree_lower_bound(arena_t *arena, size_t n);
 
 #endif
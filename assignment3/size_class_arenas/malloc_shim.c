@@ -0,0 +1,107 @@
+/**
+ * LD_PRELOAD interposition layer: exports the glibc malloc family backed by smalloc / sfree,
+ * so unmodified binaries can run on the size-class arenas:
+ *
+ *     LD_PRELOAD=./libsmalloc.so ./some_program
+ *
+ * The allocator itself never calls malloc (only mmap, pthread_once and a pthread key), so it is
+ * safe to use while the process is still starting up, and fork handlers installed on first use
+ * keep the arenas consistent in the child.
+ *
+ * SMALLOC_TRACE=<file> records every call into a binary trace (see trace.h) for
+ * c_allocation_replay.c:
+ *
+ *     SMALLOC_TRACE=app.trace LD_PRELOAD=./libsmalloc.so ./some_program
+ *
+ * SMALLOC_PROF=<file> turns on the sampling heap profiler (see prof.h) and writes a pprof heap
+ * profile of the live samples to <file> on SIGUSR2 and again at exit:
+ *
+ *     SMALLOC_PROF=app.heap LD_PRELOAD=./libsmalloc.so ./some_program &
+ *     kill -USR2 $!; pprof -top ./some_program app.heap
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "allocator.h"
+#include "prof.h"
+#include "trace.h"
+
+#define SHIM_PAGE  4096
+/* malloc(0) must return a unique pointer. No rounding is needed: every payload the allocator
+   hands out is SMALLOC_ALIGN (16) aligned, what callers expect on x86-64 (alignof(max_align_t)). */
+static inline size_t shim_size(size_t n) {
+    return n ? n : 1;
+}
+
+__attribute__((constructor)) static void shim_init(void) {
+    const char *path = getenv("SMALLOC_TRACE");
+    if (path != NULL && *path != '\0') allocator_trace_start(path);
+    const char *prof = getenv("SMALLOC_PROF");
+    if (prof != NULL && *prof != '\0' && allocator_prof_start(0) == 0) allocator_prof_signal(SIGUSR2, prof);
+}
+
+__attribute__((destructor)) static void shim_fini(void) {
+    allocator_trace_stop();
+    const char *prof = getenv("SMALLOC_PROF");
+    if (prof != NULL && *prof != '\0') allocator_prof_dump(prof, PROF_PPROF);
+}
+
+void *malloc(size_t n) {
+    return smalloc(shim_size(n));
+}
+
+void free(void *ptr) {
+    sfree(ptr);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    if (size != 0 && nmemb > SIZE_MAX / size) { errno = ENOMEM; return NULL; }
+    void *p = scalloc(1, shim_size(nmemb * size));
+    if (p == NULL) errno = ENOMEM;
+    return p;
+}
+
+void *realloc(void *ptr, size_t n) {
+    if (ptr != NULL && n == 0) { sfree(ptr); return NULL; }
+    void *p = srealloc(ptr, shim_size(n));
+    if (p == NULL) errno = ENOMEM;
+    return p;
+}
+
+void *reallocarray(void *ptr, size_t nmemb, size_t size) {
+    if (size != 0 && nmemb > SIZE_MAX / size) { errno = ENOMEM; return NULL; }
+    return realloc(ptr, nmemb * size);
+}
+
+int posix_memalign(void **out, size_t alignment, size_t n) {
+    if (alignment == 0 || alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) return EINVAL;
+    void *p = saligned_alloc(alignment, shim_size(n));
+    if (p == NULL) return ENOMEM;
+    *out = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t n) {
+    void *p = saligned_alloc(alignment, shim_size(n));
+    if (p == NULL) errno = (alignment == 0 || (alignment & (alignment - 1)) != 0) ? EINVAL : ENOMEM;
+    return p;
+}
+
+void *memalign(size_t alignment, size_t n) {
+    return aligned_alloc(alignment, n);
+}
+
+void *valloc(size_t n) {
+    return aligned_alloc(SHIM_PAGE, n);
+}
+
+void *pvalloc(size_t n) {
+    return aligned_alloc(SHIM_PAGE, (n + SHIM_PAGE - 1) & ~(size_t)(SHIM_PAGE - 1));
+}
+
+size_t malloc_usable_size(void *ptr) {
+    return susable_size(ptr);
+}
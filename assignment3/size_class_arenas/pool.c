@@ -0,0 +1,254 @@
+#include "pool.h"
+#include "allocator.h"
+
+#include <sys/mman.h>
+#include <stdint.h>
+
+/* every region starts with this header; its objects follow at the first aligned offset */
+typedef struct pool_region {
+    struct pool_region *next;
+    size_t size;                // mapped bytes
+} pool_region_t;
+
+struct pool {
+    pthread_mutex_t lock;       // guards everything below but the read-only fields
+    void *free;                 // intrusive freelist: each free object holds the next one
+    uint8_t *bump, *bump_end;   // not yet carved part of the newest region
+    pool_region_t *regions;
+    size_t n_free;              // objects on the freelist
+    size_t in_use;              // objects handed out (magazines count as handed out)
+    size_t mapped;
+    size_t obj_size, align;     // read-only after pool_create
+    size_t region_size;
+    int slot;                   // magazine slot, -1 without magazines
+    unsigned gen;               // generation of that slot when the pool took it
+};
+
+/* per-thread magazines, one per registry slot. A magazine whose generation differs from its
+   slot's current one belongs to a destroyed pool: its objects are gone and it is dropped. */
+typedef struct pool_magazine {
+    void *objs[POOL_MAG_SIZE];
+    int count;
+    unsigned gen;
+} pool_magazine_t;
+
+static __thread pool_magazine_t magazines[POOL_MAG_POOLS] __attribute__((tls_model("initial-exec")));
+static __thread int magazines_registered __attribute__((tls_model("initial-exec")));
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pool_t *registry[POOL_MAG_POOLS];
+static unsigned registry_gen[POOL_MAG_POOLS];
+static pthread_once_t pool_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pool_key;
+
+/* map a region and make it the bump area (pool->lock held) */
+static int pool_grow(pool_t *pool) {
+    pool_region_t *r = get_mem_block(NULL, pool->region_size);
+    if (r == NULL) return 0;
+    r->next = pool->regions;
+    r->size = pool->region_size;
+    pool->regions = r;
+    pool->mapped += r->size;
+    uintptr_t first = ((uintptr_t)r + sizeof(pool_region_t) + pool->align - 1) & ~(uintptr_t)(pool->align - 1);
+    pool->bump = (uint8_t*)first;
+    pool->bump_end = (uint8_t*)r + r->size;
+    return 1;
+}
+
+/* room for one more object in the bump area, which is NULL..NULL before the first region and
+   after pool_trim (no pointer arithmetic on NULL) */
+static inline int pool_bump_fits(const pool_t *pool) {
+    return pool->bump != NULL && (size_t)(pool->bump_end - pool->bump) >= pool->obj_size;
+}
+
+/* take up to count objects off the pool (pool->lock held): freelist first, then the bump area */
+static int pool_take(pool_t *pool, void **out, int count) {
+    int got = 0;
+    while (got < count) {
+        if (pool->free != NULL) {
+            out[got++] = pool->free;
+            pool->free = *(void**)pool->free;
+            pool->n_free--;
+        } else if (pool_bump_fits(pool) || pool_grow(pool)) {
+            out[got++] = pool->bump;
+            pool->bump += pool->obj_size;
+        } else {
+            break;
+        }
+    }
+    pool->in_use += (size_t)got;
+    return got;
+}
+
+/* give objects back to the freelist (pool->lock held) */
+static void pool_put(pool_t *pool, void **objs, int count) {
+    for (int k = 0; k < count; k++) {
+        *(void**)objs[k] = pool->free;
+        pool->free = objs[k];
+    }
+    pool->n_free += (size_t)count;
+    pool->in_use -= (size_t)count;
+}
+
+/* thread exit: hand the magazines of live pools back to them */
+static void pool_thread_exit(void *unused) {
+    (void)unused;
+    pthread_mutex_lock(&registry_lock);
+    for (int s = 0; s < POOL_MAG_POOLS; s++) {
+        pool_magazine_t *m = &magazines[s];
+        if (m->count > 0 && registry[s] != NULL && m->gen == registry_gen[s]) {
+            pthread_mutex_lock(&registry[s]->lock);
+            pool_put(registry[s], m->objs, m->count);
+            pthread_mutex_unlock(&registry[s]->lock);
+        }
+        m->count = 0;
+    }
+    pthread_mutex_unlock(&registry_lock);
+}
+
+static void pool_key_create(void) {
+    pthread_key_create(&pool_key, pool_thread_exit);
+}
+
+pool_t *pool_create_ex(size_t obj_size, size_t align, int flags) {
+    if (align == 0) align = sizeof(void*);
+    if ((align & (align - 1)) != 0 || align > 4096 || obj_size == 0) return NULL;
+    if (obj_size < sizeof(void*)) obj_size = sizeof(void*);
+    obj_size = (obj_size + align - 1) & ~(align - 1);
+    if (obj_size > ((size_t)1 << 30)) return NULL;
+
+    pool_t *pool = smalloc(sizeof(pool_t));
+    if (pool == NULL) return NULL;
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->free = NULL;
+    pool->bump = pool->bump_end = NULL;
+    pool->regions = NULL;
+    pool->n_free = pool->in_use = pool->mapped = 0;
+    pool->obj_size = obj_size;
+    pool->align = align;
+
+    /* at least POOL_REGION and 64 objects per region, in whole pages */
+    size_t region = sizeof(pool_region_t) + align + 64 * obj_size;
+    if (region < POOL_REGION) region = POOL_REGION;
+    pool->region_size = (region + 4095) & ~(size_t)4095;
+
+    /* magazines need a registry slot; without a free one the pool simply works without them */
+    pool->slot = -1;
+    if (flags & POOL_MAGAZINES) {
+        pthread_once(&pool_key_once, pool_key_create);
+        pthread_mutex_lock(&registry_lock);
+        for (int s = 0; s < POOL_MAG_POOLS; s++) {
+            if (registry[s] == NULL) {
+                registry[s] = pool;
+                pool->slot = s;
+                pool->gen = ++registry_gen[s];
+                break;
+            }
+        }
+        pthread_mutex_unlock(&registry_lock);
+    }
+    return pool;
+}
+
+pool_t *pool_create(size_t obj_size, size_t align) {
+    return pool_create_ex(obj_size, align, 0);
+}
+
+void pool_destroy(pool_t *pool) {
+    if (pool == NULL) return;
+    if (pool->slot >= 0) {
+        pthread_mutex_lock(&registry_lock);
+        registry[pool->slot] = NULL;
+        registry_gen[pool->slot]++;         /* every thread's magazine for it is now stale */
+        pthread_mutex_unlock(&registry_lock);
+        magazines[pool->slot].count = 0;
+    }
+    pool_region_t *r = pool->regions;
+    while (r != NULL) {
+        pool_region_t *next = r->next;
+        munmap(r, r->size);
+        r = next;
+    }
+    pthread_mutex_destroy(&pool->lock);
+    sfree(pool);
+}
+
+/* this thread's magazine for the pool, reset if it still holds a destroyed pool's objects */
+static inline pool_magazine_t *pool_magazine(pool_t *pool) {
+    pool_magazine_t *m = &magazines[pool->slot];
+    if (m->gen != pool->gen) {
+        m->gen = pool->gen;
+        m->count = 0;
+    }
+    if (!magazines_registered) {
+        magazines_registered = 1;
+        pthread_setspecific(pool_key, (void*)1);
+    }
+    return m;
+}
+
+void *pool_alloc(pool_t *pool) {
+    void *obj;
+    if (pool->slot >= 0) {
+        pool_magazine_t *m = pool_magazine(pool);
+        if (m->count == 0) {            /* refill half a magazine under one lock */
+            pthread_mutex_lock(&pool->lock);
+            m->count = pool_take(pool, m->objs, POOL_MAG_SIZE / 2);
+            pthread_mutex_unlock(&pool->lock);
+            if (m->count == 0) return NULL;
+        }
+        return m->objs[--m->count];
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    int got = pool_take(pool, &obj, 1);
+    pthread_mutex_unlock(&pool->lock);
+    return got ? obj : NULL;
+}
+
+void pool_free(pool_t *pool, void *obj) {
+    if (obj == NULL) return;
+    if (pool->slot >= 0) {
+        pool_magazine_t *m = pool_magazine(pool);
+        if (m->count == POOL_MAG_SIZE) {    /* full: return the older half under one lock */
+            pthread_mutex_lock(&pool->lock);
+            pool_put(pool, m->objs, POOL_MAG_SIZE / 2);
+            pthread_mutex_unlock(&pool->lock);
+            m->count -= POOL_MAG_SIZE / 2;
+            for (int k = 0; k < m->count; k++) m->objs[k] = m->objs[k + POOL_MAG_SIZE / 2];
+        }
+        m->objs[m->count++] = obj;
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool_put(pool, &obj, 1);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* batch prefill: carve objects onto the freelist up front, so later pool_alloc calls never map */
+size_t pool_prefill(pool_t *pool, size_t count) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->n_free < count) {
+        if (!pool_bump_fits(pool) && !pool_grow(pool)) break;
+        void *obj = pool->bump;
+        pool->bump += pool->obj_size;
+        *(void**)obj = pool->free;
+        pool->free = obj;
+        pool->n_free++;
+    }
+    size_t ready = pool->n_free;
+    pthread_mutex_unlock(&pool->lock);
+    return ready;
+}
+
+size_t pool_object_size(const pool_t *pool) {
+    return pool->obj_size;
+}
+
+void pool_stats(pool_t *pool, size_t *in_use, size_t *mapped) {
+    pthread_mutex_lock(&pool->lock);
+    if (in_use) *in_use = pool->in_use;
+    if (mapped) *mapped = pool->mapped;
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,51 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+// fixed-size object pools: objects of one size carved from regions mapped with get_mem_block,
+// recycled through an intrusive freelist (a free object holds the next one). No size routing
+// and no header, so pool_alloc / pool_free are O(1) pointer pops and pushes.
+typedef struct pool pool_t;
+
+#define POOL_REGION     (64 * 1024)     // minimum bytes mapped per region
+#define POOL_MAGAZINES  0x1             // pool_create_ex flag: per-thread magazines
+#define POOL_MAG_SIZE   32              // objects a thread's magazine holds
+#define POOL_MAG_POOLS  64              // pools with magazines alive at the same time
+
+// obj_size is rounded up to align (a power of two up to 4096) and to hold a pointer.
+// Returns NULL if the arguments are invalid or memory is exhausted.
+pool_t *pool_create(size_t obj_size, size_t align);
+pool_t *pool_create_ex(size_t obj_size, size_t align, int flags);
+void pool_destroy(pool_t *pool);        // unmaps every region; no thread may use the pool anymore
+
+void *pool_alloc(pool_t *pool);
+void pool_free(pool_t *pool, void *obj);    // obj must come from this pool
+size_t pool_prefill(pool_t *pool, size_t count);   // have count free objects ready; returns how many are
+
+size_t pool_object_size(const pool_t *pool);
+void pool_stats(pool_t *pool, size_t *in_use, size_t *mapped);
+
+// typed wrappers: POOL_DEFINE(node, struct node, POOL_MAGAZINES) generates
+//   struct node *node_alloc(void);  void node_free(struct node *);  pool_t *node_pool(void);
+// with sizeof / _Alignof of the type baked in. The pool is created on first use.
+#define POOL_DEFINE(name, type, flags)                                                      \
+    static pool_t *name##_pool_ptr;                                                         \
+    static pthread_once_t name##_pool_once = PTHREAD_ONCE_INIT;                             \
+    static void name##_pool_init(void) {                                                    \
+        name##_pool_ptr = pool_create_ex(sizeof(type), _Alignof(type), (flags));            \
+    }                                                                                       \
+    static inline pool_t *name##_pool(void) {                                               \
+        pthread_once(&name##_pool_once, name##_pool_init);                                  \
+        return name##_pool_ptr;                                                             \
+    }                                                                                       \
+    static inline type *name##_alloc(void) {                                                \
+        pool_t *p = name##_pool();                                                          \
+        return p ? (type*)pool_alloc(p) : NULL;                                             \
+    }                                                                                       \
+    static inline void name##_free(type *obj) {                                             \
+        if (obj) pool_free(name##_pool_ptr, obj);                                           \
+    }
+
+#endif
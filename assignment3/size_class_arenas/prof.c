@@ -0,0 +1,428 @@
+#define _GNU_SOURCE                 /* dladdr */
+#include "prof.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PROF_SKIP     3             // frames of prof_record, the allocator's hook and the public entry
+#define PROF_RECHECK  (1 << 20)     // bytes between looks at prof_enabled while not sampling
+#define PROF_OUT      4096          // dump output buffer
+#define PROF_PATH     512
+
+__thread int64_t prof_left __attribute__((tls_model("initial-exec")));
+
+static __thread uint64_t prof_rng __attribute__((tls_model("initial-exec")));
+static __thread unsigned prof_seen __attribute__((tls_model("initial-exec")));   // prof_gen this thread drew for
+static __thread int prof_busy __attribute__((tls_model("initial-exec")));        // inside the profiler: no sampling
+
+static _Atomic int prof_enabled = 0;
+static _Atomic unsigned prof_gen = 0;          // bumped by every start, so threads redraw
+static _Atomic size_t prof_mean = PROF_MEAN;
+static volatile sig_atomic_t prof_pending = 0; // a signal came while the tables were locked
+
+typedef struct prof_stack {
+    uint64_t hash;                  // 0 = empty slot
+    int depth;
+    void *frames[PROF_DEPTH];       // return addresses, innermost first
+    size_t live_count, live_bytes;  // sampled allocations not freed yet
+    size_t alloc_count, alloc_bytes;  // every sample since the start
+    double live_est;                // live bytes scaled back to the whole heap
+} prof_stack_t;
+
+typedef struct prof_live {
+    void *ptr;                      // NULL = empty slot
+    size_t size;
+    uint32_t stack;
+} prof_live_t;
+
+/* everything below is guarded by prof_lock. Both tables use linear probing; stack slot 0 is the
+   overflow entry for backtraces that no longer fit, live entries are deleted by backward shift */
+static pthread_mutex_t prof_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t prof_once = PTHREAD_ONCE_INIT;
+static prof_stack_t *prof_stacks = NULL;
+static prof_live_t *prof_live = NULL;
+static size_t prof_nstacks = 0, prof_nlive = 0, prof_dropped = 0;
+static char prof_signal_path[PROF_PATH];
+
+/* natural log of u in (0, 1]: exponent from the bits, ln m = 2 atanh((m - 1) / (m + 1)) for the
+   mantissa m in [1, 2). Good to about 1e-6, plenty for drawing sample distances, and no libm. */
+static double prof_ln(double u) {
+    union { double d; uint64_t b; } v = { u };
+    int e = (int)((v.b >> 52) & 0x7ff) - 1023;
+    v.b = (v.b & ~(0x7ffull << 52)) | (1023ull << 52);
+    double t = (v.d - 1) / (v.d + 1), t2 = t * t;
+    double s = 1 + t2 * (1.0 / 3 + t2 * (1.0 / 5 + t2 * (1.0 / 7 + t2 / 9)));
+    return e * 0.6931471805599453 + 2 * t * s;
+}
+
+/* e^-x for x >= 0: 2^-k from the bits, a Taylor series for the remainder r in [0, ln 2) */
+static double prof_exp_neg(double x) {
+    int k = (int)(x / 0.6931471805599453);
+    if (k >= 1000) return 0;
+    double r = x - k * 0.6931471805599453, term = 1, sum = 1;
+    for (int i = 1; i <= 10; i++) { term *= -r / i; sum += term; }
+    union { double d; uint64_t b; } scale = { .b = (uint64_t)(1023 - k) << 52 };
+    return sum * scale.d;
+}
+
+/* bytes to the next sample: exponential with the configured mean, so the sample points form a
+   Poisson process over the allocated bytes (xorshift64* per thread) */
+static int64_t prof_draw(void) {
+    if (prof_rng == 0) prof_rng = ((uint64_t)(uintptr_t)&prof_rng ^ (uint64_t)time(NULL)) | 1;
+    prof_rng ^= prof_rng >> 12;
+    prof_rng ^= prof_rng << 25;
+    prof_rng ^= prof_rng >> 27;
+    double u = (double)(((prof_rng * 0x2545f4914f6cdd1dull) >> 11) + 1) * 0x1p-53;
+    double d = -prof_ln(u) * (double)atomic_load_explicit(&prof_mean, memory_order_relaxed);
+    return (d >= (double)INT64_MAX) ? INT64_MAX : (int64_t)d + 1;
+}
+
+/* a sampled allocation of size bytes stands for size / P(sampled) bytes of the heap */
+static double prof_weight(size_t size) {
+    double mean = (double)atomic_load_explicit(&prof_mean, memory_order_relaxed);
+    double p = 1 - prof_exp_neg((double)size / mean);
+    return (p > 0) ? (double)size / p : mean;
+}
+
+static size_t prof_live_slot(const void *ptr) {
+    return (size_t)(((uintptr_t)ptr >> 4) * 0x9e3779b97f4a7c15ull >> 32) & (PROF_LIVE - 1);
+}
+
+/* ---- dump output: plain write(2) and hand-rolled number formatting, so a signal handler can use it ---- */
+
+typedef struct prof_out {
+    int fd;
+    int len;
+    char buf[PROF_OUT];
+} prof_out_t;
+
+static void out_flush(prof_out_t *o) {
+    const char *p = o->buf;
+    while (o->len > 0) {
+        ssize_t w = write(o->fd, p, (size_t)o->len);
+        if (w <= 0) break;          /* disk full: drop the rest */
+        p += w;
+        o->len -= (int)w;
+    }
+    o->len = 0;
+}
+
+static void out_mem(prof_out_t *o, const char *s, size_t n) {
+    while (n > 0) {
+        if (o->len == PROF_OUT) out_flush(o);
+        size_t k = PROF_OUT - (size_t)o->len;
+        if (k > n) k = n;
+        memcpy(o->buf + o->len, s, k);
+        o->len += (int)k;
+        s += k;
+        n -= k;
+    }
+}
+
+static void out_str(prof_out_t *o, const char *s) { out_mem(o, s, strlen(s)); }
+
+static void out_num(prof_out_t *o, uint64_t v, int base, int width) {
+    char tmp[24];
+    int i = sizeof(tmp);
+    do { tmp[--i] = "0123456789abcdef"[v % (unsigned)base]; v /= (unsigned)base; } while (v > 0);
+    while (i > (int)sizeof(tmp) - width) tmp[--i] = (base == 16) ? '0' : ' ';
+    out_mem(o, tmp + i, sizeof(tmp) - (size_t)i);
+}
+
+/* legacy heap profile text (gperftools format), read by pprof:
+     heap profile: <live>: <live bytes> [<allocs>: <alloc bytes>] @ heap_v2/<mean>
+     <live>: <live bytes> [<allocs>: <alloc bytes>] @ 0x<pc> 0x<pc> ...
+   then MAPPED_LIBRARIES: and a copy of /proc/self/maps to symbolize with. Counts are raw samples;
+   pprof scales them back with the mean in the header. (prof_lock held) */
+static void dump_pprof(prof_out_t *o) {
+    size_t lc = 0, lb = 0, ac = 0, ab = 0;
+    for (size_t s = 0; prof_stacks != NULL && s < PROF_STACKS; s++) {
+        lc += prof_stacks[s].live_count;
+        lb += prof_stacks[s].live_bytes;
+        ac += prof_stacks[s].alloc_count;
+        ab += prof_stacks[s].alloc_bytes;
+    }
+    size_t counts[4] = { lc, lb, ac, ab };
+    out_str(o, "heap profile: ");
+    for (int k = 0; k < 4; k++) {
+        out_num(o, counts[k], 10, 6);
+        out_str(o, (k == 0 || k == 2) ? ": " : (k == 1) ? " [" : "] @ heap_v2/");
+    }
+    out_num(o, atomic_load_explicit(&prof_mean, memory_order_relaxed), 10, 0);
+    out_str(o, "\n");
+
+    for (size_t s = 0; prof_stacks != NULL && s < PROF_STACKS; s++) {
+        prof_stack_t *st = &prof_stacks[s];
+        if (st->alloc_count == 0) continue;
+        size_t c[4] = { st->live_count, st->live_bytes, st->alloc_count, st->alloc_bytes };
+        for (int k = 0; k < 4; k++) {
+            out_num(o, c[k], 10, 6);
+            out_str(o, (k == 0 || k == 2) ? ": " : (k == 1) ? " [" : "] @");
+        }
+        for (int f = 0; f < st->depth; f++) {
+            out_str(o, " 0x");
+            out_num(o, (uintptr_t)st->frames[f], 16, 16);
+        }
+        out_str(o, "\n");
+    }
+
+    out_str(o, "\nMAPPED_LIBRARIES:\n");
+    out_flush(o);
+    int maps = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (maps < 0) return;
+    ssize_t r;
+    while ((r = read(maps, o->buf, PROF_OUT)) > 0) {
+        o->len = (int)r;
+        out_flush(o);
+    }
+    close(maps);
+}
+
+/* one frame of a folded stack: symbol, else module+offset, else the address */
+static void out_frame(prof_out_t *o, void *pc) {
+    Dl_info info;
+    if (dladdr((char*)pc - 1, &info) && info.dli_sname != NULL) {
+        out_str(o, info.dli_sname);
+    } else if (dladdr((char*)pc - 1, &info) && info.dli_fname != NULL) {
+        const char *base = strrchr(info.dli_fname, '/');
+        out_str(o, base ? base + 1 : info.dli_fname);
+        out_str(o, "+0x");
+        out_num(o, (uintptr_t)pc - (uintptr_t)info.dli_fbase, 16, 0);
+    } else {
+        out_str(o, "0x");
+        out_num(o, (uintptr_t)pc, 16, 0);
+    }
+}
+
+/* folded stacks, one line per backtrace holding live memory: frames root first, separated by
+   ';', then the estimated live bytes. Feed to flamegraph.pl or speedscope. (prof_lock held) */
+static void dump_folded(prof_out_t *o) {
+    for (size_t s = 0; prof_stacks != NULL && s < PROF_STACKS; s++) {
+        prof_stack_t *st = &prof_stacks[s];
+        if (st->live_count == 0) continue;
+        if (st->depth == 0) out_str(o, "[overflow]");
+        for (int f = st->depth - 1; f >= 0; f--) {
+            out_frame(o, st->frames[f]);
+            if (f > 0) out_str(o, ";");
+        }
+        out_str(o, " ");
+        out_num(o, (st->live_est > 0) ? (uint64_t)(st->live_est + 0.5) : 0, 10, 0);
+        out_str(o, "\n");
+    }
+}
+
+static int prof_dump_fd(int fd, int format) {
+    prof_out_t o = { .fd = fd, .len = 0 };
+    if (format == PROF_FOLDED) dump_folded(&o);
+    else dump_pprof(&o);
+    out_flush(&o);
+    return 0;
+}
+
+/* ---- sampling ---- */
+
+/* fork: the child keeps the samples of the thread that forked, the tables stay consistent */
+static void prof_fork_prepare(void) { pthread_mutex_lock(&prof_lock); }
+static void prof_fork_release(void) { pthread_mutex_unlock(&prof_lock); }
+
+static void prof_register(void) {
+    pthread_atfork(prof_fork_prepare, prof_fork_release, prof_fork_release);
+    /* backtrace loads the unwinder (and mallocs) on its first call: do that here, not while
+       sampling inside the allocator */
+    void *frames[1];
+    prof_busy = 1;
+    backtrace(frames, 1);
+    prof_busy = 0;
+}
+
+int allocator_prof_start(size_t mean_bytes) {
+    pthread_once(&prof_once, prof_register);
+    pthread_mutex_lock(&prof_lock);
+    if (prof_stacks == NULL) {
+        void *s = mmap(NULL, PROF_STACKS * sizeof(prof_stack_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        void *l = mmap(NULL, PROF_LIVE * sizeof(prof_live_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (s == MAP_FAILED || l == MAP_FAILED) {
+            if (s != MAP_FAILED) munmap(s, PROF_STACKS * sizeof(prof_stack_t));
+            if (l != MAP_FAILED) munmap(l, PROF_LIVE * sizeof(prof_live_t));
+            pthread_mutex_unlock(&prof_lock);
+            return -1;
+        }
+        prof_stacks = s;
+        prof_live = l;
+    } else {                        /* restart: blocks tagged before are simply not found */
+        memset(prof_stacks, 0, PROF_STACKS * sizeof(prof_stack_t));
+        memset(prof_live, 0, PROF_LIVE * sizeof(prof_live_t));
+    }
+    prof_nstacks = prof_nlive = prof_dropped = 0;
+    atomic_store(&prof_mean, mean_bytes ? mean_bytes : PROF_MEAN);
+    atomic_fetch_add(&prof_gen, 1);
+    atomic_store(&prof_enabled, 1);
+    pthread_mutex_unlock(&prof_lock);
+    return 0;
+}
+
+void allocator_prof_stop(void) {
+    atomic_store(&prof_enabled, 0);
+}
+
+int allocator_prof_dump(const char *path, int format) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    prof_busy = 1;                  /* dladdr may allocate: never sample that */
+    pthread_mutex_lock(&prof_lock);
+    prof_dump_fd(fd, format);
+    pthread_mutex_unlock(&prof_lock);
+    prof_busy = 0;
+    return close(fd);
+}
+
+/* dump from the handler when the tables are free; otherwise the thread holding them was
+   interrupted, and the next sampling decision of any thread writes the dump */
+static void prof_signal_dump(void) {
+    int fd = open(prof_signal_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return;
+    prof_dump_fd(fd, PROF_PPROF);
+    close(fd);
+}
+
+static void prof_handler(int signo) {
+    (void)signo;
+    int saved = errno;
+    if (pthread_mutex_trylock(&prof_lock) == 0) {
+        prof_signal_dump();
+        pthread_mutex_unlock(&prof_lock);
+    } else {
+        prof_pending = 1;
+    }
+    errno = saved;
+}
+
+int allocator_prof_signal(int signo, const char *path) {
+    if (strlen(path) >= PROF_PATH) return -1;
+    pthread_mutex_lock(&prof_lock);
+    strcpy(prof_signal_path, path);
+    pthread_mutex_unlock(&prof_lock);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = prof_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    return sigaction(signo, &sa, NULL);
+}
+
+/* slow path of PROF_SAMPLE: this thread's countdown ran out. Draw the next distance and take
+   the sample, unless profiling is off (look again in PROF_RECHECK bytes) or was (re)started
+   since this thread last drew, in which case the new distance is all it gets. */
+int prof_due(void) {
+    if (prof_busy) { prof_left = PROF_RECHECK; return 0; }
+    if (prof_pending) {
+        prof_pending = 0;
+        pthread_mutex_lock(&prof_lock);
+        prof_signal_dump();
+        pthread_mutex_unlock(&prof_lock);
+    }
+    if (!atomic_load_explicit(&prof_enabled, memory_order_relaxed)) {
+        prof_left = PROF_RECHECK;
+        return 0;
+    }
+    prof_left = prof_draw();
+    unsigned gen = atomic_load_explicit(&prof_gen, memory_order_relaxed);
+    if (prof_seen != gen) {
+        prof_seen = gen;
+        return 0;
+    }
+    return 1;
+}
+
+/* record a sampled allocation with the backtrace of its caller. Called from the allocator's
+   hook, itself called from the public entry point: both frames are dropped (PROF_SKIP). */
+void prof_record(void *ptr, size_t size) {
+    void *frames[PROF_DEPTH + PROF_SKIP];
+    prof_busy = 1;
+    int depth = backtrace(frames, PROF_DEPTH + PROF_SKIP) - PROF_SKIP;
+    if (depth < 0) depth = 0;
+
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (int f = 0; f < depth; f++) h = (h ^ (uintptr_t)frames[PROF_SKIP + f]) * 0x100000001b3ull;
+    h |= 1;                         /* 0 marks an empty slot */
+
+    pthread_mutex_lock(&prof_lock);
+    if (prof_stacks == NULL || prof_nlive >= PROF_LIVE / 4 * 3) {
+        prof_dropped++;
+        pthread_mutex_unlock(&prof_lock);
+        prof_busy = 0;
+        return;
+    }
+
+    size_t s = (size_t)(h >> 20) % (PROF_STACKS - 1) + 1;
+    for (;;) {
+        prof_stack_t *st = &prof_stacks[s];
+        if (st->hash == h && st->depth == depth &&
+            memcmp(st->frames, frames + PROF_SKIP, (size_t)depth * sizeof(void*)) == 0) break;
+        if (st->hash == 0) {
+            if (prof_nstacks >= (PROF_STACKS - 1) / 4 * 3) { s = 0; break; }  /* overflow entry */
+            st->hash = h;
+            st->depth = depth;
+            memcpy(st->frames, frames + PROF_SKIP, (size_t)depth * sizeof(void*));
+            prof_nstacks++;
+            break;
+        }
+        s = (s == PROF_STACKS - 1) ? 1 : s + 1;
+    }
+    prof_stack_t *st = &prof_stacks[s];
+    st->live_count++;
+    st->live_bytes += size;
+    st->alloc_count++;
+    st->alloc_bytes += size;
+    st->live_est += prof_weight(size);
+
+    size_t i = prof_live_slot(ptr);
+    while (prof_live[i].ptr != NULL) i = (i + 1) & (PROF_LIVE - 1);
+    prof_live[i].ptr = ptr;
+    prof_live[i].size = size;
+    prof_live[i].stack = (uint32_t)s;
+    prof_nlive++;
+    pthread_mutex_unlock(&prof_lock);
+    prof_busy = 0;
+}
+
+/* a sampled block is being freed (or reallocated in place) */
+void prof_forget(void *ptr) {
+    pthread_mutex_lock(&prof_lock);
+    size_t i = prof_live_slot(ptr);
+    while (prof_live != NULL && prof_live[i].ptr != NULL && prof_live[i].ptr != ptr) i = (i + 1) & (PROF_LIVE - 1);
+    if (prof_live == NULL || prof_live[i].ptr == NULL) {    /* dropped, or from before a restart */
+        pthread_mutex_unlock(&prof_lock);
+        return;
+    }
+
+    prof_stack_t *st = &prof_stacks[prof_live[i].stack];
+    st->live_count--;
+    st->live_bytes -= prof_live[i].size;
+    st->live_est -= prof_weight(prof_live[i].size);
+    prof_nlive--;
+
+    /* backward-shift delete: pull later entries of the probe run into the hole when their home
+       slot does not lie cyclically in (hole, entry] */
+    size_t j = i;
+    for (;;) {
+        j = (j + 1) & (PROF_LIVE - 1);
+        if (prof_live[j].ptr == NULL) break;
+        size_t k = prof_live_slot(prof_live[j].ptr);
+        if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) continue;
+        prof_live[i] = prof_live[j];
+        i = j;
+    }
+    prof_live[i].ptr = NULL;
+    pthread_mutex_unlock(&prof_lock);
+}
@@ -0,0 +1,42 @@
+#ifndef PROF_H
+#define PROF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// sampling heap profiler: about one allocation per mean_bytes allocated (geometric sampling, so
+// every byte has the same chance) records its backtrace and stays in a table of live samples
+// until it is freed. A dump shows which call sites hold the live memory, scaled back to
+// estimated bytes. Sampled blocks are tagged in their header, so sfree finds them without a
+// lookup. No malloc anywhere: the tables are mapped once by allocator_prof_start.
+#define PROF_MEAN        (512 * 1024)   // default bytes between samples
+#define PROF_DEPTH       32             // frames kept per backtrace
+#define PROF_STACKS      8192           // distinct backtraces (more land in one overflow entry)
+#define PROF_LIVE        (1 << 16)      // live samples tracked at a time
+
+#define PROF_FOLDED      0      // "root;...;caller live_bytes" per backtrace (flamegraph.pl, speedscope)
+#define PROF_PPROF       1      // legacy heap profile text with /proc/self/maps (pprof)
+
+int allocator_prof_start(size_t mean_bytes);        // 0 = PROF_MEAN; -1 if the tables cannot be mapped
+void allocator_prof_stop(void);                     // no new samples; live ones stay until freed
+int allocator_prof_dump(const char *path, int format);  // 0, or -1 if the file cannot be written
+int allocator_prof_signal(int signo, const char *path); // dump PROF_PPROF to path on signal signo
+
+// allocator side. The fast path of every allocation is PROF_SAMPLE: a per-thread countdown of
+// bytes until the next sample; prof_due redraws it and tells whether to take one.
+extern __thread int64_t prof_left __attribute__((tls_model("initial-exec")));
+#define PROF_SAMPLE(n) ((prof_left -= (int64_t)(n)) < 0 && prof_due())
+
+int prof_due(void);
+void prof_record(void *ptr, size_t size);
+void prof_forget(void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+#include "region.h"
+#include "allocator.h"
+
+#include <sys/mman.h>
+#include <stdint.h>
+
+/* every chunk starts with this header; chunks form a stack, newest first */
+typedef struct region_chunk {
+    struct region_chunk *prev;
+    uint8_t *base, *ptr, *end;  // payload start, bump pointer (kept REGION_ALIGN aligned), end
+    size_t size;                // bytes of the chunk, header included
+} region_chunk_t;
+
+/* the region itself lives at the start of the first chunk's mapping */
+struct region {
+    region_chunk_t *cur;        // newest chunk, the one region_alloc bumps through
+    region_chunk_t first;
+    region_chunk_t *spare;      // chunks popped by resets, reused before smalloc is called again
+    size_t next_size;           // size of the next chained chunk
+    size_t reserved;            // bytes mapped or taken from the arenas
+};
+
+#define ALIGN_UP(x, a) (((uintptr_t)(x) + (a) - 1) & ~(uintptr_t)((a) - 1))
+
+/* payload runs from just after start to the end of the size bytes at mem */
+static void chunk_init(region_chunk_t *c, region_chunk_t *prev, void *mem, void *start, size_t size) {
+    c->prev = prev;
+    c->base = c->ptr = (uint8_t*)ALIGN_UP(start, REGION_ALIGN);
+    c->end = (uint8_t*)mem + size;
+    c->size = size;
+}
+
+region_t *region_create(size_t chunk_size) {
+    if (chunk_size == 0) chunk_size = REGION_CHUNK;
+    if (chunk_size > ((size_t)1 << 40)) return NULL;
+    size_t size = (sizeof(region_t) + REGION_ALIGN + chunk_size + 4095) & ~(size_t)4095;
+
+    region_t *region = get_mem_block(NULL, size);
+    if (region == NULL) return NULL;
+    chunk_init(&region->first, NULL, region, region + 1, size);
+    region->cur = &region->first;
+    region->spare = NULL;
+    region->next_size = chunk_size < REGION_CHUNK_MAX ? chunk_size : REGION_CHUNK_MAX;
+    region->reserved = size;
+    return region;
+}
+
+/* chain a new chunk from the arenas with room for n bytes at alignment align */
+static region_chunk_t *region_grow(region_t *region, size_t n, size_t align) {
+    if (n > ((size_t)1 << 40)) return NULL;
+    size_t need = sizeof(region_chunk_t) + REGION_ALIGN + align + n;
+    size_t size = region->next_size;
+    if (size < need) size = need;       /* oversized request: a chunk of its own */
+
+    /* a spare that fits saves the round trip through the arenas on every request */
+    region_chunk_t **link = &region->spare;
+    while (*link != NULL && (*link)->size < need) link = &(*link)->prev;
+    if (*link != NULL) {
+        region_chunk_t *c = *link;
+        *link = c->prev;
+        chunk_init(c, region->cur, c, c + 1, c->size);
+        region->cur = c;
+        return c;
+    }
+
+    region_chunk_t *c = smalloc(size);
+    if (c == NULL) return NULL;
+    chunk_init(c, region->cur, c, c + 1, size);
+    region->cur = c;
+    region->reserved += size;
+    if (region->next_size < REGION_CHUNK_MAX) region->next_size *= 2;
+    return c;
+}
+
+void *region_alloc(region_t *region, size_t n) {
+    if (n > ((size_t)1 << 40)) return NULL;     /* before the rounding can wrap it to 0 */
+    region_chunk_t *c = region->cur;
+    n = (n + REGION_ALIGN - 1) & ~(size_t)(REGION_ALIGN - 1);
+    if (n > (size_t)(c->end - c->ptr)) {
+        c = region_grow(region, n, 0);
+        if (c == NULL) return NULL;
+    }
+    void *p = c->ptr;
+    c->ptr += n;
+    return p;
+}
+
+void *region_alloc_aligned(region_t *region, size_t align, size_t n) {
+    if ((align & (align - 1)) != 0 || align > 4096 || n > ((size_t)1 << 40)) return NULL;
+    if (align < REGION_ALIGN) align = REGION_ALIGN;
+    region_chunk_t *c = region->cur;
+    n = (n + REGION_ALIGN - 1) & ~(size_t)(REGION_ALIGN - 1);
+    uint8_t *p = (uint8_t*)ALIGN_UP(c->ptr, align);
+    if (p > c->end || n > (size_t)(c->end - p)) {
+        c = region_grow(region, n, align);
+        if (c == NULL) return NULL;
+        p = (uint8_t*)ALIGN_UP(c->ptr, align);
+    }
+    c->ptr = p + n;
+    return p;
+}
+
+region_mark_t region_mark(region_t *region) {
+    region_mark_t mark = { region->cur, (size_t)(region->cur->ptr - region->cur->base) };
+    return mark;
+}
+
+/* pop the chunks chained after the mark onto the spares, then rewind its chunk */
+void region_reset_to_mark(region_t *region, region_mark_t mark) {
+    region_chunk_t *c = region->cur;
+    while (c != mark.chunk && c != &region->first) {
+        region_chunk_t *prev = c->prev;
+        c->prev = region->spare;
+        region->spare = c;
+        c = prev;
+    }
+    region->cur = c;
+    c->ptr = (c == mark.chunk) ? c->base + mark.used : c->base;
+}
+
+void region_reset(region_t *region) {
+    region_mark_t start = { &region->first, 0 };
+    region_reset_to_mark(region, start);
+}
+
+/* hand the spare chunks back to the arenas */
+void region_trim(region_t *region) {
+    while (region->spare != NULL) {
+        region_chunk_t *c = region->spare;
+        region->spare = c->prev;
+        region->reserved -= c->size;
+        sfree(c);
+    }
+}
+
+void region_destroy(region_t *region) {
+    if (region == NULL) return;
+    region_reset(region);
+    region_trim(region);
+    munmap(region, region->first.size);
+}
+
+void region_stats(region_t *region, size_t *used, size_t *reserved) {
+    size_t u = 0;
+    for (region_chunk_t *c = region->cur; c != NULL; c = c->prev) u += (size_t)(c->ptr - c->base);
+    if (used) *used = u;
+    if (reserved) *reserved = region->reserved;
+}
@@ -0,0 +1,46 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// region (bump) allocator for request-scoped memory: region_alloc bumps a pointer through the
+// current chunk, and everything is released at once by a reset or region_destroy instead of one
+// sfree per object. The first chunk is mapped with get_mem_block and kept across resets; when it
+// is full, further chunks are chained from the size-class arenas (smalloc). A reset keeps the
+// chunks it pops as spares for the next request; region_trim or region_destroy hands them back
+// to the arenas. A region is not thread-safe: use one per request / thread.
+typedef struct region region_t;
+
+#define REGION_CHUNK     (64 * 1024)    // default size of the first chunk
+#define REGION_CHUNK_MAX (1024 * 1024)  // chained chunks double up to here (bigger requests get their own)
+#define REGION_ALIGN     16             // alignment of every region_alloc payload
+
+// position in a region: region_reset_to_mark frees everything allocated after it was taken.
+// Resetting to a mark invalidates the marks taken after it.
+typedef struct region_mark {
+    void *chunk;
+    size_t used;
+} region_mark_t;
+
+region_t *region_create(size_t chunk_size);    // chunk_size 0 = REGION_CHUNK; NULL if out of memory
+void region_destroy(region_t *region);          // O(chunks)
+
+void *region_alloc(region_t *region, size_t n);                  // NULL if out of memory
+void *region_alloc_aligned(region_t *region, size_t align, size_t n);  // align: a power of two up to 4096
+
+region_mark_t region_mark(region_t *region);
+void region_reset_to_mark(region_t *region, region_mark_t mark);
+void region_reset(region_t *region);            // free everything
+void region_trim(region_t *region);             // return the spare chunks to the arenas
+
+void region_stats(region_t *region, size_t *used, size_t *reserved);  // bytes handed out / held
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,9 +1,87 @@
+
 # Run the c_allocation_stress_test.c file along with the other c files 
-gcc -O2 -Wall -Wextra allocator.c freelist.c c_allocation_stress_test.c -o multi_arenas_stress_test
+gcc -O2 -Wall -Wextra -pthread allocator.c freelist.c slab.c trace.c prof.c c_allocation_stress_test.c -o multi_arenas_stress_test
 
 # Display the results of the test in the terminal output 
 ./multi_arenas_stress_test
 #  To include the runtime display
 time ./multi_arenas_stress_test
 
-# Need to change the fit strategy and merge enable in cthe code itself
+# Multi-threaded variant: throughput on 1..N threads (N defaults to the number of CPUs)
+gcc -O2 -Wall -Wextra -pthread allocator.c freelist.c slab.c trace.c prof.c c_allocation_stress_test_mt.c -o multi_arenas_stress_test_mt
+./multi_arenas_stress_test_mt 8
+
+# Two-thread ping-pong: every sfree is a cross-thread free
+gcc -O2 -Wall -Wextra -pthread allocator.c freelist.c slab.c trace.c prof.c c_allocation_pingpong_test.c -o multi_arenas_pingpong_test
+./multi_arenas_pingpong_test
+
+# Comparative benchmark: the same workloads on the arenas, the single-heap allocator and glibc,
+# one CSV row (or JSON line with "json") per allocator and workload
+gcc -O2 -Wall -Wextra -pthread allocator.c freelist.c slab.c trace.c prof.c c_allocation_bench.c -o bench_arenas
+gcc -O2 -Wall -Wextra -pthread -DBENCH_SINGLE_HEAP ../stress_test_version_2/allocator.c ../stress_test_version_2/freelist.c c_allocation_bench.c -o bench_single_heap
+gcc -O2 -Wall -Wextra -pthread -DBENCH_SYSTEM c_allocation_bench.c -o bench_glibc
+./bench_arenas > bench.csv
+./bench_single_heap | tail -n +2 >> bench.csv
+./bench_glibc | tail -n +2 >> bench.csv
+
+# Drop-in malloc replacement: build the shared library and preload it into any program
+gcc -O2 -Wall -Wextra -fPIC -shared -pthread allocator.c freelist.c slab.c trace.c prof.c malloc_shim.c -o libsmalloc.so
+LD_PRELOAD=./libsmalloc.so /usr/bin/time -v python3 -c "print(sum(len(str(i)) for i in range(10**6)))"
+#  Same program on glibc malloc, to compare time and maximum resident set size
+/usr/bin/time -v python3 -c "print(sum(len(str(i)) for i in range(10**6)))"
+
+# Record an allocation trace of any program, then replay it against other settings
+# (fit strategy and merging on the command line, everything else through SMALLOC_CONF)
+SMALLOC_TRACE=python.trace LD_PRELOAD=./libsmalloc.so python3 -c "print(sum(len(str(i)) for i in range(10**6)))"
+gcc -O2 -Wall -Wextra -pthread allocator.c freelist.c slab.c trace.c prof.c c_allocation_replay.c -o replay
+./replay python.trace tlsf
+SMALLOC_CONF=small_max:4K,med_max:64K ./replay python.trace tlsf nomerge
+
+# Settings are read from SMALLOC_CONF at startup (see allocator.h), no rebuild needed, e.g.
+SMALLOC_CONF=fit:first,merge:0 ./multi_arenas_stress_test
+SMALLOC_CONF=fit:tlsf,arenas:2,small_max:4K,large_heap:2M,purge:256K ./multi_arenas_stress_test
+#  Let the boundaries and chunk sizes follow the observed request sizes
+SMALLOC_CONF=adaptive:1 ./multi_arenas_stress_test
+#  Cap the mapped memory and let full arenas borrow their neighbours' free blocks
+SMALLOC_CONF=heap_limit:16M,spill:eager ./multi_arenas_stress_test
+
+# Fixed-size object pools (pool.h) against smalloc, with and without per-thread magazines
+gcc -O2 -Wall -Wextra -pthread allocator.c freelist.c slab.c trace.c prof.c pool.c c_allocation_pool_test.c -o pool_test
+./pool_test
+
+# Region (bump) allocator for request-scoped memory against one sfree per object
+gcc -O2 -Wall -Wextra -pthread allocator.c freelist.c slab.c trace.c prof.c region.c c_allocation_region_test.c -o region_test
+./region_test
+
+# Batch API: bursts of messages with smalloc_batch / sfree_batch against one call per message
+gcc -O2 -Wall -Wextra -pthread allocator.c freelist.c slab.c trace.c prof.c c_allocation_batch_test.c -o batch_test
+./batch_test
+#  Best fit in the large arena is answered by its size trees, which pays off when its bins get long
+SMALLOC_CONF=fit:best,arenas:1,merge:0 ./multi_arenas_stress_test
+
+# C++: STL containers on the arenas (smalloc_resource.hpp) against the default allocator.
+# The allocator is C11, so its files are built with gcc and linked into the C++ program
+gcc -O2 -Wall -Wextra -pthread -c allocator.c freelist.c slab.c trace.c prof.c region.c
+g++ -O2 -Wall -Wextra -std=c++17 -pthread allocator.o freelist.o slab.o trace.o prof.o region.o c_allocation_pmr_bench.cpp -o pmr_bench
+./pmr_bench
+
+# Sampling heap profiler: live heap per call site, estimated from about one sample per 64K
+# allocated, against the truth; writes prof.folded (flamegraph.pl) and prof.heap (pprof).
+# -rdynamic lets the folded dump name the functions, -g lets pprof symbolize
+gcc -O2 -g -Wall -Wextra -pthread -rdynamic allocator.c freelist.c slab.c trace.c prof.c c_allocation_prof_test.c -o prof_test
+./prof_test
+go tool pprof -top prof_test prof.heap
+#  Any program through the shim: SIGUSR2 (and the exit) writes its live samples
+SMALLOC_PROF=python.heap LD_PRELOAD=./libsmalloc.so python3 -c "print(sum(len(str(i)) for i in range(10**6)))"
+
+# Transparent huge pages for the arena chunks: the stress workload on a large working set with
+# thp:0 and thp:1 (dTLB misses where the CPU exposes the counters, page faults, AnonHugePages)
+gcc -O2 -Wall -Wextra -pthread allocator.c freelist.c slab.c trace.c prof.c c_allocation_thp_bench.c -o thp_bench
+./thp_bench
+#  The same counters on the stress test itself
+SMALLOC_CONF=thp:1 perf stat -e dTLB-load-misses,dTLB-store-misses,page-faults ./multi_arenas_stress_test
+
+# 16-byte alignment on every path (slab, thread cache, arena, huge, calloc, realloc, aligned,
+# batch), checked with aligned SSE loads, and the arena bytes each live object takes
+gcc -O2 -Wall -Wextra -pthread allocator.c freelist.c slab.c trace.c prof.c c_allocation_align_test.c -o align_test
+./align_test
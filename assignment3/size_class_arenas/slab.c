@@ -0,0 +1,165 @@
+#include "slab.h"
+#include "allocator.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+/* header at the start of every slab page */
+typedef struct slab {
+    struct slab *next, *prev;   // partial list of its class
+    void *free;                 // embedded freelist: each free slot holds the next one
+    int cls;
+    int used;                   // slots handed out
+} slab_t;
+
+#define SLAB_HDR   ((sizeof(slab_t) + 15) & ~(size_t)15)
+#define SLAB_OF(p) ((slab_t*)((uintptr_t)(p) & ~(uintptr_t)(SLAB_PAGE - 1)))
+
+/* multiples of 16 only: slots are carved back from the page end, so every slot is 16-aligned */
+static const unsigned short class_size[SLAB_CLASSES] = {
+    16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256
+};
+static unsigned char class_of_size[SLAB_MAX / 8 + 1];   // indexed by (n + 7) / 8
+
+typedef struct slab_class_state {
+    pthread_mutex_t lock;
+    slab_t *partial;            // slabs with at least one free slot
+} slab_class_state_t;
+
+static slab_class_state_t classes[SLAB_CLASSES];
+
+/* page pool: bump pointer over the slab heap plus a stack of released pages */
+static pthread_mutex_t page_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t *pages_start = NULL, *pages_end = NULL, *pages_bump = NULL;
+static void *free_pages = NULL;
+static size_t pages_in_use = 0;
+
+void slab_init(void *mem, size_t mem_size) {
+    if (mem == NULL) return;
+    pages_start = pages_bump = (uint8_t*)mem;
+    pages_end = pages_start + (mem_size & ~(size_t)(SLAB_PAGE - 1));
+
+    for (int c = 0, n = 0; n <= SLAB_MAX; n += 8) {
+        while (class_size[c] < n) c++;
+        class_of_size[n / 8] = (unsigned char)c;
+    }
+    for (int c = 0; c < SLAB_CLASSES; c++) pthread_mutex_init(&classes[c].lock, NULL);
+}
+
+int slab_class(size_t n) {
+    return class_of_size[(n + 7) / 8];
+}
+
+size_t slab_class_size(int cls) {
+    return class_size[cls];
+}
+
+int slab_owns(const void *ptr) {
+    return (const uint8_t*)ptr >= pages_start && (const uint8_t*)ptr < pages_end;
+}
+
+int slab_class_of(const void *ptr) {
+    return SLAB_OF(ptr)->cls;
+}
+
+/* take a page from the pool and thread all its slots into the embedded freelist */
+static slab_t *slab_new(int cls) {
+    pthread_mutex_lock(&page_lock);
+    uint8_t *page = free_pages;
+    if (page) free_pages = *(void**)page;
+    else if (pages_bump < pages_end) { page = pages_bump; pages_bump += SLAB_PAGE; }
+    if (page) pages_in_use++;
+    pthread_mutex_unlock(&page_lock);
+    if (page == NULL) return NULL;
+
+    slab_t *slab = (slab_t*)page;
+    size_t sz = class_size[cls];
+    slab->cls = cls;
+    slab->used = 0;
+    slab->free = NULL;
+    for (uint8_t *slot = page + SLAB_PAGE - sz; slot >= page + SLAB_HDR; slot -= sz) {
+        *(void**)slot = slab->free;
+        slab->free = slot;
+    }
+    return slab;
+}
+
+static void slab_release(slab_t *slab) {
+    pthread_mutex_lock(&page_lock);
+    *(void**)slab = free_pages;
+    free_pages = slab;
+    pages_in_use--;
+    pthread_mutex_unlock(&page_lock);
+}
+
+static void partial_push(slab_class_state_t *st, slab_t *slab) {
+    slab->prev = NULL;
+    slab->next = st->partial;
+    if (st->partial) st->partial->prev = slab;
+    st->partial = slab;
+}
+
+static void partial_remove(slab_class_state_t *st, slab_t *slab) {
+    if (slab->prev) slab->prev->next = slab->next;
+    else st->partial = slab->next;
+    if (slab->next) slab->next->prev = slab->prev;
+}
+
+int slab_alloc_batch(int cls, void **out, int count) {
+    slab_class_state_t *st = &classes[cls];
+    int got = 0;
+
+    pthread_mutex_lock(&st->lock);
+    while (got < count) {
+        slab_t *slab = st->partial;
+        if (slab == NULL) {
+            slab = slab_new(cls);
+            if (slab == NULL) break;    // slab heap exhausted
+            partial_push(st, slab);
+        }
+        void *slot = slab->free;
+        slab->free = *(void**)slot;
+        slab->used++;
+        if (slab->free == NULL) partial_remove(st, slab);   // full: off the partial list
+        out[got++] = slot;
+    }
+    pthread_mutex_unlock(&st->lock);
+    return got;
+}
+
+void slab_free_batch(int cls, void **ptrs, int count) {
+    slab_class_state_t *st = &classes[cls];
+
+    pthread_mutex_lock(&st->lock);
+    for (int i = 0; i < count; i++) {
+        slab_t *slab = SLAB_OF(ptrs[i]);
+        if (slab->free == NULL) partial_push(st, slab);     // was full
+        *(void**)ptrs[i] = slab->free;
+        slab->free = ptrs[i];
+        slab->used--;
+
+        /* give empty pages back, but keep one partial slab per class to avoid thrashing */
+        if (slab->used == 0 && (slab->prev || slab->next)) {
+            partial_remove(st, slab);
+            slab_release(slab);
+        }
+    }
+    pthread_mutex_unlock(&st->lock);
+}
+
+void slab_stats(size_t *pages_used, size_t *pages_total) {
+    pthread_mutex_lock(&page_lock);
+    if (pages_used) *pages_used = pages_in_use;
+    if (pages_total) *pages_total = (size_t)(pages_end - pages_start) / SLAB_PAGE;
+    pthread_mutex_unlock(&page_lock);
+}
+
+void slab_lock_all(void) {
+    for (int c = 0; c < SLAB_CLASSES; c++) pthread_mutex_lock(&classes[c].lock);
+    pthread_mutex_lock(&page_lock);
+}
+
+void slab_unlock_all(void) {
+    pthread_mutex_unlock(&page_lock);
+    for (int c = SLAB_CLASSES - 1; c >= 0; c--) pthread_mutex_unlock(&classes[c].lock);
+}
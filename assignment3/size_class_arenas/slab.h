@@ -0,0 +1,28 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+
+// slab tier: page-sized slabs carved into equal, header-less slots. The slab header sits at
+// the start of its page, so a slot finds its size class by masking its own address.
+#define SLAB_PAGE     4096
+#define SLAB_CLASSES  12
+
+void slab_init(void *mem, size_t mem_size);
+
+int slab_class(size_t n);                   // size class for a payload n <= SLAB_MAX
+size_t slab_class_size(int cls);            // slot size of a class
+int slab_owns(const void *ptr);             // ptr is a slot of the slab tier
+int slab_class_of(const void *ptr);         // size class of a slot, read from its page
+
+// both take the class lock once for the whole batch
+int slab_alloc_batch(int cls, void **out, int count);   // returns the number of slots allocated
+void slab_free_batch(int cls, void **ptrs, int count);
+
+void slab_stats(size_t *pages_used, size_t *pages_total);
+
+// fork handlers: hold every slab lock across fork()
+void slab_lock_all(void);
+void slab_unlock_all(void);
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef SMALLOC_RESOURCE_HPP
+#define SMALLOC_RESOURCE_HPP
+
+// C++ adapters over the size-class arenas (C++17):
+//   smalloc_resource           std::pmr::memory_resource over smalloc / sfree
+//   arena_monotonic_resource   std::pmr::memory_resource over a region (region.h): bump
+//                              allocation, deallocate is a no-op, release() frees everything
+//   smalloc_allocator<T>       std::allocator-compatible template over smalloc / sfree
+// Build the C files with gcc and link them into the C++ program (see run_commands.sh).
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include "allocator.h"   // smalloc, sfree, saligned_alloc
+#include "region.h"      // region_create, region_alloc_aligned, region_reset, region_destroy
+
+// bytes at alignment align from the arenas; throws std::bad_alloc. Every smalloc payload is
+// SMALLOC_ALIGN aligned, so only stricter alignments pay for saligned_alloc.
+inline void *smalloc_aligned(std::size_t bytes, std::size_t align) {
+    std::size_t n = bytes ? bytes : 1;
+    if (align <= SMALLOC_ALIGN) {
+        void *p = smalloc(n);
+        if (p == nullptr) throw std::bad_alloc();
+        return p;
+    }
+    void *p = saligned_alloc(align, n);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+// sfree finds the size and owner of a block from the block itself, so the size and alignment
+// the standard passes to deallocate are not needed
+class smalloc_resource : public std::pmr::memory_resource {
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t align) override {
+        return smalloc_aligned(bytes, align);
+    }
+    void do_deallocate(void *p, std::size_t, std::size_t) override {
+        sfree(p);
+    }
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return dynamic_cast<const smalloc_resource*>(&other) != nullptr;   // all share the arenas
+    }
+};
+
+// process-wide instance, like std::pmr::new_delete_resource()
+inline smalloc_resource *smalloc_default_resource() noexcept {
+    static smalloc_resource resource;
+    return &resource;
+}
+
+// monotonic resource on a region: the first chunk is mapped, later ones are chained from the
+// arenas, so memory for request-scoped containers costs a pointer bump. Not thread-safe.
+class arena_monotonic_resource : public std::pmr::memory_resource {
+public:
+    explicit arena_monotonic_resource(std::size_t chunk_size = 0) : region_(region_create(chunk_size)) {
+        if (region_ == nullptr) throw std::bad_alloc();
+    }
+    ~arena_monotonic_resource() override { region_destroy(region_); }
+    arena_monotonic_resource(const arena_monotonic_resource&) = delete;
+    arena_monotonic_resource &operator=(const arena_monotonic_resource&) = delete;
+
+    void release() noexcept { region_reset(region_); }    // every container on it must be gone
+    region_t *region() noexcept { return region_; }
+
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t align) override {
+        void *p = region_alloc_aligned(region_, align, bytes);
+        if (p == nullptr) throw std::bad_alloc();
+        return p;
+    }
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+private:
+    region_t *region_;
+};
+
+// std::allocator replacement: std::vector<int, smalloc_allocator<int>>
+template <class T>
+struct smalloc_allocator {
+    using value_type = T;
+
+    smalloc_allocator() noexcept = default;
+    template <class U> smalloc_allocator(const smalloc_allocator<U>&) noexcept {}
+
+    T *allocate(std::size_t n) {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) throw std::bad_array_new_length();
+        return static_cast<T*>(smalloc_aligned(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T *p, std::size_t) noexcept { sfree(p); }
+};
+
+template <class T, class U>
+bool operator==(const smalloc_allocator<T>&, const smalloc_allocator<U>&) noexcept { return true; }
+template <class T, class U>
+bool operator!=(const smalloc_allocator<T>&, const smalloc_allocator<U>&) noexcept { return false; }
+
+#endif
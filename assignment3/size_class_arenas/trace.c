@@ -0,0 +1,125 @@
+#include "trace.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRACE_BUF 4096              // records buffered before a write()
+
+_Atomic int trace_enabled = 0;
+
+/* everything below is guarded by trace_lock. No malloc anywhere: the tracer runs inside the
+   allocator, possibly in an LD_PRELOAD library */
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static trace_record_t trace_buf[TRACE_BUF];
+static int trace_len = 0;
+static int trace_fd = -1;
+static uint64_t trace_t0 = 0;
+
+static _Atomic int trace_threads = 0;
+static __thread uint16_t trace_tid __attribute__((tls_model("initial-exec")));
+
+static uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* write out the buffered records (trace_lock held) */
+static void trace_flush(void) {
+    size_t left = (size_t)trace_len * sizeof(trace_record_t);
+    const char *p = (const char*)trace_buf;
+    while (left > 0) {
+        ssize_t w = write(trace_fd, p, left);
+        if (w <= 0) break;          /* disk full or closed: drop the rest */
+        p += w;
+        left -= (size_t)w;
+    }
+    trace_len = 0;
+}
+
+/* fork: the child must not write the parent's buffered records a second time */
+static void trace_fork_prepare(void) { pthread_mutex_lock(&trace_lock); }
+static void trace_fork_parent(void)  { pthread_mutex_unlock(&trace_lock); }
+static void trace_fork_child(void) {
+    atomic_store(&trace_enabled, 0);
+    if (trace_fd >= 0) close(trace_fd);
+    trace_fd = -1;
+    trace_len = 0;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/* registered once: fork handlers, and a final flush when the program exits without stopping */
+static void trace_register(void) {
+    pthread_atfork(trace_fork_prepare, trace_fork_parent, trace_fork_child);
+    atexit(allocator_trace_stop);
+}
+
+int allocator_trace_start(const char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    pthread_once(&trace_once, trace_register);
+
+    pthread_mutex_lock(&trace_lock);
+    if (trace_fd >= 0) {            /* restart: finish the previous trace first */
+        trace_flush();
+        close(trace_fd);
+    }
+    trace_fd = fd;
+    trace_len = 0;
+    trace_t0 = trace_now();
+    if (write(fd, TRACE_MAGIC, 8) != 8) {
+        close(fd);
+        trace_fd = -1;
+        pthread_mutex_unlock(&trace_lock);
+        return -1;
+    }
+    atomic_store(&trace_enabled, 1);
+    pthread_mutex_unlock(&trace_lock);
+    return 0;
+}
+
+void allocator_trace_stop(void) {
+    pthread_mutex_lock(&trace_lock);
+    atomic_store(&trace_enabled, 0);
+    if (trace_fd >= 0) {
+        trace_flush();
+        close(trace_fd);
+        trace_fd = -1;
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/* append one record (trace_lock held) */
+static void trace_append(int op, const void *ptr, size_t size, int arg, uint64_t ts) {
+    if (trace_tid == 0) trace_tid = (uint16_t)(atomic_fetch_add(&trace_threads, 1) + 1);
+    trace_record_t *r = &trace_buf[trace_len++];
+    r->ts_ns = ts - trace_t0;
+    r->ptr = (uint64_t)(uintptr_t)ptr;
+    r->size = (size > UINT32_MAX) ? UINT32_MAX : (uint32_t)size;
+    r->thread = trace_tid;
+    r->op = (uint8_t)op;
+    r->arg = (uint8_t)arg;
+    if (trace_len == TRACE_BUF) trace_flush();
+}
+
+void trace_event(int op, const void *ptr, size_t size, int arg) {
+    uint64_t ts = trace_now();
+    pthread_mutex_lock(&trace_lock);
+    if (trace_fd >= 0) trace_append(op, ptr, size, arg, ts);
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/* both halves of a realloc go in under one lock hold, so they stay adjacent */
+void trace_realloc(const void *old, const void *ptr, size_t size) {
+    uint64_t ts = trace_now();
+    pthread_mutex_lock(&trace_lock);
+    if (trace_fd >= 0) {
+        trace_append(TRACE_REALLOC_FROM, old, 0, 0, ts);
+        trace_append(TRACE_REALLOC, ptr, size, 0, ts);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
@@ -0,0 +1,40 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+// allocation trace: every smalloc / scalloc / saligned_alloc / srealloc / sfree call is appended
+// to a binary file as one fixed-size record (a realloc is two). The records of all threads are
+// serialized under one lock, so the file order is a valid single-threaded replay order.
+// File layout: TRACE_MAGIC, then trace_record_t records until the end of the file.
+#define TRACE_MAGIC "SMTRACE1"      // 8 bytes
+
+#define TRACE_MALLOC        1       // ptr = result (0 if it failed), size = request
+#define TRACE_FREE          2       // ptr = freed pointer
+#define TRACE_CALLOC        3       // ptr = result, size = nmemb * size
+#define TRACE_ALIGNED       4       // ptr = result, size = request, arg = log2(alignment)
+#define TRACE_REALLOC_FROM  5       // ptr = old pointer; always directly followed by TRACE_REALLOC
+#define TRACE_REALLOC       6       // ptr = result (0 if it failed: the old one stays live), size = request
+
+typedef struct trace_record {
+    uint64_t ts_ns;                 // nanoseconds since the trace started
+    uint64_t ptr;                   // address returned or released in the traced process
+    uint32_t size;                  // requested bytes (clamped to UINT32_MAX)
+    uint16_t thread;                // small per-thread id, 1 for the first thread traced
+    uint8_t  op;                    // TRACE_*
+    uint8_t  arg;
+} trace_record_t;
+
+extern _Atomic int trace_enabled;   // checked on every call: the fast path only pays this load
+
+int allocator_trace_start(const char *path);    // returns 0 on success, -1 if path can't be opened
+void allocator_trace_stop(void);                // flush and close the trace file
+
+void trace_event(int op, const void *ptr, size_t size, int arg);
+void trace_realloc(const void *old, const void *ptr, size_t size);
+
+#define TRACE_ON() __builtin_expect(atomic_load_explicit(&trace_enabled, memory_order_relaxed), 0)
+
+#endif